@@ -0,0 +1,286 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <predef/predef.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef PREDEF_OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ast_cache.h"
+#include "hashers.h"
+#include "typedefs.h"
+#include "util.h"
+
+// Bump this whenever the tree's representation, or this file's, changes
+#define AST_CACHE_VERSION 4
+
+#define AST_CACHE_ALIGN(n) (((n) + 7) / 8 * 8)
+
+// Everything that has to match for a cache to be used. There's no padding,
+// so that two keys can be compared with memcmp.
+typedef struct {
+  char magic[8];
+  u32 version;
+  // 0x01020304, in the writer's byte order
+  u32 byte_order;
+  u64 source_hash;
+  // Catches node types being renumbered, or changing representation, without
+  // the version being bumped
+  u64 node_types_hash;
+  u32 source_len;
+  u8 node_data_size;
+  u8 phase_data_size;
+  u8 node_ind_size;
+  u8 token_len_size;
+} ast_cache_key;
+
+// This goes at the end of the file, so that the arrays start the mapping
+typedef struct {
+  ast_cache_key key;
+  // Over the arrays, so that a corrupt cache isn't used
+  u64 arrays_hash;
+  // These are all node_ind_ts, widened so that the trailer has no padding
+  u32 node_amt;
+  u32 ind_amt;
+  u32 token_amt;
+  u32 root_subs_start;
+  u32 root_subs_amt;
+  u32 max_depth;
+} ast_cache_trailer;
+
+// Where each array starts. The node arrays are laid out like the parser's
+// allocation, and the token arrays are laid out like the parser's token
+// allocation.
+typedef struct {
+  size_t phase_data;
+  size_t inds;
+  size_t tags;
+  size_t token_starts;
+  size_t token_lens;
+  size_t trailer;
+  size_t total;
+} ast_cache_layout;
+
+static ast_cache_stats stats = {0};
+
+static const char node_types[] =
+#define X(enum_name, str, cat, subs) #enum_name " " #subs "\n"
+  DECL_PARSE_NODES
+#undef X
+  ;
+
+static ast_cache_key cache_key(const char *source) {
+  buf_ind_t source_len = strlen(source);
+  ast_cache_key key = {
+    .magic = "PIQAST",
+    .version = AST_CACHE_VERSION,
+    .byte_order = 0x01020304,
+    .source_hash = hash_source(source, source_len),
+    .node_types_hash = hash_source(node_types, sizeof(node_types) - 1),
+    .source_len = source_len,
+    .node_data_size = sizeof(parse_node_data),
+    .phase_data_size = sizeof(parse_node_phase_data),
+    .node_ind_size = sizeof(node_ind_t),
+    .token_len_size = sizeof(token_len_t),
+  };
+  return key;
+}
+
+static ast_cache_layout cache_layout(node_ind_t node_amt, node_ind_t ind_amt,
+                                     node_ind_t token_amt) {
+  ast_cache_layout res;
+  res.phase_data = sizeof(parse_node_data) * node_amt;
+  res.inds = res.phase_data + sizeof(parse_node_phase_data) * node_amt;
+  res.tags = res.inds + sizeof(node_ind_t) * ind_amt;
+  res.token_starts = AST_CACHE_ALIGN(res.tags + node_amt);
+  res.token_lens = res.token_starts + sizeof(buf_ind_t) * token_amt;
+  res.trailer =
+    AST_CACHE_ALIGN(res.token_lens + sizeof(token_len_t) * token_amt);
+  res.total = res.trailer + sizeof(ast_cache_trailer);
+  return res;
+}
+
+// hash_source takes a u32 length, so big arrays are hashed in pieces
+static u64 hash_array(u64 hash, const void *data, size_t bytes) {
+  const char *p = data;
+  do {
+    const size_t piece = MIN(bytes, (size_t)1 << 30);
+    hash = (hash ^ hash_source(p, piece)) * 0x9E3779B185EBCA87ULL;
+    p += piece;
+    bytes -= piece;
+  } while (bytes > 0);
+  return hash;
+}
+
+static u64 hash_tree_arrays(const parse_tree *tree) {
+  u64 hash = 0;
+  hash =
+    hash_array(hash, tree->node_data, sizeof(parse_node_data) * tree->node_amt);
+  hash = hash_array(
+    hash, tree->phase_data, sizeof(parse_node_phase_data) * tree->node_amt);
+  hash = hash_array(hash, tree->inds, sizeof(node_ind_t) * tree->ind_amt);
+  hash = hash_array(hash, tree->tags, tree->node_amt);
+  hash =
+    hash_array(hash, tree->token_starts, sizeof(buf_ind_t) * tree->token_amt);
+  hash =
+    hash_array(hash, tree->token_lens, sizeof(token_len_t) * tree->token_amt);
+  return hash;
+}
+
+static bool write_all(FILE *f, const void *data, size_t bytes) {
+  return fwrite(data, 1, bytes, f) == bytes;
+}
+
+#ifdef PREDEF_OS_WINDOWS
+
+// Caches are mapped in, which we only do on POSIX, so they're not written
+// either
+bool write_ast_cache(const char *path, const char *source, parse_tree tree) {
+  (void)path;
+  (void)source;
+  (void)tree;
+  return false;
+}
+
+bool load_ast_cache(const char *path, const char *source, parse_tree *tree) {
+  (void)path;
+  (void)source;
+  (void)tree;
+  stats.misses++;
+  return false;
+}
+
+#else
+
+bool write_ast_cache(const char *path, const char *source, parse_tree tree) {
+  static const char padding[8] = {0};
+  const ast_cache_layout layout =
+    cache_layout(tree.node_amt, tree.ind_amt, tree.token_amt);
+  const ast_cache_trailer trailer = {
+    .key = cache_key(source),
+    .arrays_hash = hash_tree_arrays(&tree),
+    .node_amt = tree.node_amt,
+    .ind_amt = tree.ind_amt,
+    .token_amt = tree.token_amt,
+    .root_subs_start = tree.root_subs_start,
+    .root_subs_amt = tree.root_subs_amt,
+    .max_depth = tree.max_depth,
+  };
+
+  // Written to the side, and moved into place, so that a reader never sees
+  // half a cache. The name is unique, so concurrent writers can't interleave.
+  char *tmp_path;
+  asprintf(&tmp_path, "%s.XXXXXX", path);
+  const int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    free(tmp_path);
+    return false;
+  }
+  FILE *f = fdopen(fd, "wb");
+  if (f == NULL) {
+    close(fd);
+    remove(tmp_path);
+    free(tmp_path);
+    return false;
+  }
+  bool ok =
+    write_all(f, tree.node_data, layout.phase_data) &&
+    write_all(f, tree.phase_data, layout.inds - layout.phase_data) &&
+    write_all(f, tree.inds, layout.tags - layout.inds) &&
+    write_all(f, tree.tags, tree.node_amt) &&
+    write_all(
+      f, padding, layout.token_starts - layout.tags - tree.node_amt) &&
+    write_all(f, tree.token_starts, layout.token_lens - layout.token_starts) &&
+    write_all(f, tree.token_lens, sizeof(token_len_t) * tree.token_amt) &&
+    write_all(f,
+              padding,
+              layout.trailer - layout.token_lens -
+                sizeof(token_len_t) * tree.token_amt) &&
+    write_all(f, &trailer, sizeof(trailer));
+  ok &= fclose(f) == 0;
+  ok = ok && rename(tmp_path, path) == 0;
+  if (!ok) {
+    remove(tmp_path);
+  }
+  free(tmp_path);
+  return ok;
+}
+
+static bool load_ast_cache_internal(const char *path, const char *source,
+                                    parse_tree *tree) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      (uintmax_t)st.st_size < sizeof(ast_cache_trailer)) {
+    close(fd);
+    return false;
+  }
+  size_t bytes = st.st_size;
+  // Private, so that resolution can write to the nodes without touching
+  // the file
+  char *data =
+    mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  ast_cache_trailer trailer;
+  memcpy(&trailer, data + bytes - sizeof(trailer), sizeof(trailer));
+  const ast_cache_key key = cache_key(source);
+  const ast_cache_layout layout =
+    cache_layout(trailer.node_amt, trailer.ind_amt, trailer.token_amt);
+  if (memcmp(&trailer.key, &key, sizeof(key)) != 0 || layout.total != bytes ||
+      trailer.root_subs_amt > trailer.ind_amt ||
+      trailer.root_subs_start != trailer.ind_amt - trailer.root_subs_amt) {
+    munmap(data, bytes);
+    return false;
+  }
+
+  parse_tree res = {
+    .node_data = (parse_node_data *)data,
+    .phase_data = (parse_node_phase_data *)(data + layout.phase_data),
+    .inds = (node_ind_t *)(data + layout.inds),
+    .tags = (u8 *)(data + layout.tags),
+    .token_starts = (buf_ind_t *)(data + layout.token_starts),
+    .token_lens = (token_len_t *)(data + layout.token_lens),
+    .token_amt = trailer.token_amt,
+    .root_subs_start = trailer.root_subs_start,
+    .root_subs_amt = trailer.root_subs_amt,
+    .max_depth = trailer.max_depth,
+    .node_amt = trailer.node_amt,
+    .ind_amt = trailer.ind_amt,
+    .mapped_bytes = bytes,
+  };
+  if (hash_tree_arrays(&res) != trailer.arrays_hash) {
+    munmap(data, bytes);
+    return false;
+  }
+  *tree = res;
+  return true;
+}
+
+bool load_ast_cache(const char *path, const char *source, parse_tree *tree) {
+  bool hit = load_ast_cache_internal(path, source, tree);
+  if (hit) {
+    stats.hits++;
+  } else {
+    stats.misses++;
+  }
+  return hit;
+}
+
+#endif
+
+ast_cache_stats get_ast_cache_stats(void) {
+  return stats;
+}
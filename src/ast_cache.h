@@ -0,0 +1,35 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "parse_tree.h"
+
+// A parse tree's arrays, written out as they are in memory, followed by a
+// trailer saying what they're for. Node and token indices are relative, so
+// the arrays can be mapped anywhere, and used in place.
+//
+// Caches from another version of the format, or a build with different index
+// sizes, byte order or node types, or for different source, are ignored, as
+// are caches whose arrays don't match their checksum.
+#define AST_CACHE_EXTENSION ".piqast"
+
+typedef struct {
+  u32 hits;
+  u32 misses;
+} ast_cache_stats;
+
+// Writes a freshly parsed tree, before resolution fills anything in. Returns
+// whether the cache was written.
+bool write_ast_cache(const char *path, const char *source, parse_tree tree);
+
+// Maps the tree for `source` back in from a cache, if there's a valid one.
+// The mapping is copy-on-write, so later phases can fill in node data as
+// usual, and free_parse_tree unmaps it.
+bool load_ast_cache(const char *path, const char *source, parse_tree *tree);
+
+// How many loads have found a valid cache, and how many haven't
+ast_cache_stats get_ast_cache_stats(void);
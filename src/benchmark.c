@@ -2,10 +2,17 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "benchmark.h"
+#include "perf.h"
+#include "resolve_scope.h"
+#include "strint.h"
+#include "symbol_table.h"
 #include "test_upto.h"
+#include "token.h"
 #include "util.h"
 
 #define INDENT_STR "   "
@@ -17,6 +24,16 @@
 const int FUNCTION_AMT = 400;
 const int STATEMENT_AMT = 400;
 
+const size_t RESCAN_SOURCE_BYTES = 1024 * 1024;
+const int RESCAN_EDIT_AMT = 1000;
+
+const size_t INT_LITERAL_AMT = 1024 * 1024;
+
+const size_t PARSER_DRIVER_SOURCE_BYTES = 1024 * 1024;
+const int PARSER_DRIVER_RUNS = 5;
+
+const int RESOLVER_RUNS = 5;
+
 typedef void (*fn_type)(void);
 
 static char *do_nothing(fn_type f, void *data) {
@@ -87,4 +104,289 @@ static void run_compile_benchmark(test_state *state) {
   test_group_end(state);
 }
 
-void run_benchmarks(test_state *state) { run_compile_benchmark(state); }
+// Small functions, until we have at least `bytes` of source
+static char *gen_small_functions(size_t bytes) {
+  stringstream ss;
+  ss_init_immovable(&ss);
+  for (int i = 0; (size_t)ftell(ss.stream) < bytes; i++) {
+    fprintf(ss.stream,
+            "(sig (Fn I32 I32 I32))\n"
+            "(fun " FUNCTION_STR "%d (a b)\n" INDENT_STR
+            "(i32-add a (i32-add b %d)))\n\n",
+            i,
+            i);
+  }
+  ss_finalize(&ss);
+  return ss.string;
+}
+
+// Symbol ids depend on the order names were interned in, so a rescan's ids
+// needn't match a fresh scan's. Compare the names instead.
+static bool same_symbol(tokens_res a, tokens_res b, size_t i) {
+  const symbol_id sa = a.symbols[i];
+  const symbol_id sb = b.symbols[i];
+  if (sa == SYMBOL_NONE || sb == SYMBOL_NONE) {
+    return sa == sb;
+  }
+  const u32 len = symbol_len(a.symbol_table, sa);
+  return len == symbol_len(b.symbol_table, sb) &&
+         memcmp(symbol_name(a.symbol_table, sa),
+                symbol_name(b.symbol_table, sb),
+                len) == 0;
+}
+
+// Single character edits to a 1MiB source, as an editor would make
+static void run_rescan_benchmark(test_state *state) {
+  char *input = gen_small_functions(RESCAN_SOURCE_BYTES);
+  const size_t len = strlen(input);
+  source_file file = {.path = "BENCHMARK", .data = input};
+
+  test_group_start(state, "Benchmark");
+  test_start(state, "Incremental rescan");
+  tokens_res tres = test_upto_tokens(state, input);
+  if (tres.succeeded) {
+    for (int i = 0; i < RESCAN_EDIT_AMT; i++) {
+      // Swapping one lowercase letter for another always scans
+      buf_ind_t pos = abs(rand()) % len;
+      while (input[pos] < 'a' || input[pos] > 'z') {
+        pos = (pos + 1) % len;
+      }
+      input[pos] = 'a' + (input[pos] - 'a' + 1) % 26;
+      source_edit edit = {
+        .start = pos,
+        .old_end = pos + 1,
+        .new_end = pos + 1,
+      };
+      rescan_edit(&tres, file, edit);
+      add_rescan_timings(state, tres);
+      if (!tres.succeeded) {
+        failf(state, "Rescanning failed at %" PRBI, tres.error_pos);
+        break;
+      }
+    }
+  }
+  if (tres.succeeded) {
+    tokens_res expected = scan_all(file);
+    test_assert_eq(state, tres.token_amt, expected.token_amt);
+    if (expected.succeeded && tres.token_amt == expected.token_amt) {
+      const size_t amt = tres.token_amt;
+      test_assert(state,
+                  memcmp(tres.starts, expected.starts,
+                         amt * sizeof(buf_ind_t)) == 0);
+      test_assert(state,
+                  memcmp(tres.lens, expected.lens,
+                         amt * sizeof(token_len_t)) == 0);
+      test_assert(state,
+                  memcmp(tres.types, expected.types,
+                         amt * sizeof(token_type)) == 0);
+      for (size_t i = 0; i < amt; i++) {
+        if (!same_symbol(tres, expected, i)) {
+          failf(state, "Rescanned symbol differs at token %zu", i);
+          break;
+        }
+      }
+    }
+    free_tokens_res(expected);
+  }
+  free_tokens_res(tres);
+  test_end(state);
+  test_group_end(state);
+  free(input);
+}
+
+// Functions of lets, which refer back to random earlier lets
+static char *gen_let_chains(void) {
+  stringstream ss;
+  ss_init_immovable(&ss);
+  for (int i = 0; i < FUNCTION_AMT; i++) {
+    fprintf(ss.stream,
+            "(sig (Fn I32 I32 I32))\n"
+            "(fun " FUNCTION_STR "%d (a b)\n" INDENT_STR "(let " BINDING_STR
+            "0 a)\n",
+            i);
+    for (int j = 1; j < STATEMENT_AMT; j++) {
+      const int backref = abs(rand()) % j;
+      fprintf(ss.stream,
+              INDENT_STR "(let " BINDING_STR "%d (i32-add " BINDING_STR
+                         "%d b))\n",
+              j,
+              backref);
+    }
+    fprintf(ss.stream, INDENT_STR BINDING_STR "%d)\n\n", STATEMENT_AMT - 1);
+  }
+  ss_finalize(&ss);
+  return ss.string;
+}
+
+static uint64_t rand_u64(void) {
+  return (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ (uint64_t)rand();
+}
+
+// Like the data tables we get as inputs, so mostly short literals, but with
+// every width represented. Even literals are decimal, odd ones hexadecimal.
+static void run_strint_benchmark(test_state *state) {
+  stringstream ss;
+  ss_init_immovable(&ss);
+  size_t *starts = malloc(sizeof(size_t) * INT_LITERAL_AMT);
+  for (size_t i = 0; i < INT_LITERAL_AMT; i++) {
+    uint64_t val = rand_u64() >> (rand() % 64);
+    starts[i] = ftell(ss.stream);
+    fprintf(ss.stream, i % 2 == 0 ? "%" PRIu64 " " : "%" PRIx64 " ", val);
+  }
+  ss_finalize(&ss);
+
+  test_group_start(state, "Benchmark");
+  test_start(state, "Integer literals");
+  {
+#ifdef TIME_TOKENIZER
+    perf_state perf_state = perf_start();
+#endif
+    uint64_t sum = 0;
+    bool overflowed = false;
+    for (size_t i = 0; i < INT_LITERAL_AMT; i++) {
+      const char *str = ss.string + starts[i];
+      // minus the trailing space
+      size_t len = (i + 1 < INT_LITERAL_AMT ? starts[i + 1] : ss.size) -
+                   starts[i] - 1;
+      sum += i % 2 == 0 ? parse_uint64_base10(&overflowed, str, len)
+                        : parse_uint64_base16(&overflowed, str, len);
+    }
+#ifdef TIME_TOKENIZER
+    state->total_int_literal_perf =
+      perf_add(state->total_int_literal_perf, perf_end(perf_state));
+    state->total_int_literals_parsed += INT_LITERAL_AMT;
+    state->total_int_literal_bytes += ss.size - INT_LITERAL_AMT;
+#endif
+    test_assert(state, !overflowed);
+
+    uint64_t expected = 0;
+    for (size_t i = 0; i < INT_LITERAL_AMT; i++) {
+      expected += strtoull(ss.string + starts[i], NULL, i % 2 == 0 ? 10 : 16);
+    }
+    test_assert_eq(state, sum, expected);
+  }
+  test_end(state);
+  test_group_end(state);
+  free(starts);
+  free(ss.string);
+}
+
+#ifdef TIME_PARSER
+static void add_parser_driver_timings(test_state *state, parser_driver driver,
+                                      tokens_res tres, parse_tree_res pres) {
+  switch (driver) {
+    case PARSER_DRIVER_LEMON:
+      state->total_lemon_driver_perf =
+        perf_add(state->total_lemon_driver_perf, pres.perf_values);
+      state->total_lemon_driver_tokens += tres.token_amt;
+      break;
+    case PARSER_DRIVER_TABLE:
+      state->total_table_driver_perf =
+        perf_add(state->total_table_driver_perf, pres.perf_values);
+      state->total_table_driver_tokens += tres.token_amt;
+      break;
+  }
+}
+#endif
+
+// Both drivers on the same tokens, which have to give the same tree
+static void run_parser_driver_benchmark(test_state *state) {
+  char *input = gen_small_functions(PARSER_DRIVER_SOURCE_BYTES);
+
+  test_group_start(state, "Benchmark");
+  test_start(state, "Parser drivers");
+  tokens_res tres = test_upto_tokens(state, input);
+  if (tres.succeeded) {
+    char *expected = NULL;
+    // Alternating, so that neither driver gets a warmer cache
+    for (int i = 0; i < PARSER_DRIVER_RUNS * 2; i++) {
+      parser_driver driver =
+        i % 2 == 0 ? PARSER_DRIVER_LEMON : PARSER_DRIVER_TABLE;
+      parse_tree_res pres = parse_with_driver(tres, driver);
+#ifdef TIME_PARSER
+      add_parser_driver_timings(state, driver, tres, pres);
+#endif
+      if (!pres.success) {
+        failf(state,
+              "%s driver failed to parse",
+              driver == PARSER_DRIVER_LEMON ? "Lemon" : "Table");
+        free_parse_tree_res(pres);
+        break;
+      }
+      char *tree_str = print_parse_tree_str(input, pres.tree);
+      if (expected == NULL) {
+        expected = tree_str;
+      } else {
+        test_assert_eq(state, strcmp(tree_str, expected), 0);
+        free(tree_str);
+      }
+      free_parse_tree_res(pres);
+    }
+    free(expected);
+  }
+  free_tokens_res(tres);
+  test_end(state);
+  test_group_end(state);
+  free(input);
+}
+
+#ifdef TIME_NAME_RESOLUTION
+static void add_resolver_timings(test_state *state, resolver resolver,
+                                 resolution_res res) {
+  switch (resolver) {
+    case RESOLVER_HASHED:
+      state->total_hashed_resolver_perf =
+        perf_add(state->total_hashed_resolver_perf, res.perf_values);
+      state->total_hashed_resolver_names += res.num_names_looked_up;
+      break;
+    case RESOLVER_SYMBOLS:
+      state->total_symbol_resolver_perf =
+        perf_add(state->total_symbol_resolver_perf, res.perf_values);
+      state->total_symbol_resolver_names += res.num_names_looked_up;
+      break;
+  }
+}
+#endif
+
+// Both resolvers on the same tree, which have to resolve every name the same
+static void run_resolver_benchmark(test_state *state) {
+  char *input = gen_let_chains();
+
+  test_group_start(state, "Benchmark");
+  test_start(state, "Name resolvers");
+  parse_tree_res pres = test_upto_parse_tree(state, input);
+  if (pres.success) {
+    const size_t data_bytes = sizeof(parse_node_data) * pres.tree.node_amt;
+    parse_node_data *expected = NULL;
+    // Alternating, so that neither resolver gets a warmer cache
+    for (int i = 0; i < RESOLVER_RUNS * 2; i++) {
+      resolver resolver = i % 2 == 0 ? RESOLVER_HASHED : RESOLVER_SYMBOLS;
+      resolution_res res = resolve_bindings_with(pres.tree, input, resolver);
+#ifdef TIME_NAME_RESOLUTION
+      add_resolver_timings(state, resolver, res);
+#endif
+      test_assert_eq(state, res.not_found.binding_amt, 0);
+      free(res.not_found.bindings);
+      if (expected == NULL) {
+        expected = malloc(data_bytes);
+        memcpy(expected, pres.tree.node_data, data_bytes);
+      } else {
+        test_assert_eq(
+          state, memcmp(pres.tree.node_data, expected, data_bytes), 0);
+      }
+    }
+    free(expected);
+  }
+  free_parse_tree_res(pres);
+  test_end(state);
+  test_group_end(state);
+  free(input);
+}
+
+void run_benchmarks(test_state *state) {
+  run_compile_benchmark(state);
+  run_rescan_benchmark(state);
+  run_strint_benchmark(state);
+  run_parser_driver_benchmark(state);
+  run_resolver_benchmark(state);
+}
@@ -0,0 +1,27 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "builtin_names.h"
+
+// FNV-1a. Builtin names are short, so this is over before anything fancier
+// would have got going.
+u32 builtin_name_hash(const char *name, size_t len) {
+  u32 res = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    res ^= (u8)name[i];
+    res *= 16777619u;
+  }
+  return res;
+}
+
+// Murmur3's finalizer, so that each seed shuffles every bit
+u32 builtin_name_slot(u32 hash, u8 seed) {
+  hash ^= seed * 0x9e3779b9u;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
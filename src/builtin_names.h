@@ -0,0 +1,119 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+
+#include "typedefs.h"
+
+// The names of builtins, in the order of their indices. These are kept apart
+// from builtins.h, so that gen_builtin_hash can build its tables from them
+// without pulling in LLVM.
+
+#define DECL_BUILTIN_TYPE_NAMES                                                \
+  X(bool_type_ind, "Bool")                                                     \
+  X(u8_type_ind, "U8")                                                         \
+  X(u16_type_ind, "U16")                                                       \
+  X(u32_type_ind, "U32")                                                       \
+  X(u64_type_ind, "U64")                                                       \
+  X(i8_type_ind, "I8")                                                         \
+  X(i16_type_ind, "I16")                                                       \
+  X(i32_type_ind, "I32")                                                       \
+  X(i64_type_ind, "I64")                                                       \
+  X(string_type_ind, "String")
+
+#define DECL_BUILTIN_TERM_NAMES                                                \
+  X(true_builtin, "True")                                                      \
+  X(false_builtin, "False")                                                    \
+  X(i8_eq_builtin, "i8-eq?")                                                   \
+  X(i16_eq_builtin, "i16-eq?")                                                 \
+  X(i32_eq_builtin, "i32-eq?")                                                 \
+  X(i64_eq_builtin, "i64-eq?")                                                 \
+  X(u8_eq_builtin, "u8-eq?")                                                   \
+  X(u16_eq_builtin, "u16-eq?")                                                 \
+  X(u32_eq_builtin, "u32-eq?")                                                 \
+  X(u64_eq_builtin, "u64-eq?")                                                 \
+  X(i8_gt_builtin, "i8-gt?")                                                   \
+  X(i16_gt_builtin, "i16-gt?")                                                 \
+  X(i32_gt_builtin, "i32-gt?")                                                 \
+  X(i64_gt_builtin, "i64-gt?")                                                 \
+  X(u8_gt_builtin, "u8-gt?")                                                   \
+  X(u16_gt_builtin, "u16-gt?")                                                 \
+  X(u32_gt_builtin, "u32-gt?")                                                 \
+  X(u64_gt_builtin, "u64-gt?")                                                 \
+  X(i8_gte_builtin, "i8-gte?")                                                 \
+  X(i16_gte_builtin, "i16-gte?")                                               \
+  X(i32_gte_builtin, "i32-gte?")                                               \
+  X(i64_gte_builtin, "i64-gte?")                                               \
+  X(u8_gte_builtin, "u8-gte?")                                                 \
+  X(u16_gte_builtin, "u16-gte?")                                               \
+  X(u32_gte_builtin, "u32-gte?")                                               \
+  X(u64_gte_builtin, "u64-gte?")                                               \
+  X(i8_lt_builtin, "i8-lt?")                                                   \
+  X(i16_lt_builtin, "i16-lt?")                                                 \
+  X(i32_lt_builtin, "i32-lt?")                                                 \
+  X(i64_lt_builtin, "i64-lt?")                                                 \
+  X(u8_lt_builtin, "u8-lt?")                                                   \
+  X(u16_lt_builtin, "u16-lt?")                                                 \
+  X(u32_lt_builtin, "u32-lt?")                                                 \
+  X(u64_lt_builtin, "u64-lt?")                                                 \
+  X(i8_lte_builtin, "i8-lte?")                                                 \
+  X(i16_lte_builtin, "i16-lte?")                                               \
+  X(i32_lte_builtin, "i32-lte?")                                               \
+  X(i64_lte_builtin, "i64-lte?")                                               \
+  X(u8_lte_builtin, "u8-lte?")                                                 \
+  X(u16_lte_builtin, "u16-lte?")                                               \
+  X(u32_lte_builtin, "u32-lte?")                                               \
+  X(u64_lte_builtin, "u64-lte?")                                               \
+  X(i8_add_builtin, "i8-add")                                                  \
+  X(i16_add_builtin, "i16-add")                                                \
+  X(i32_add_builtin, "i32-add")                                                \
+  X(i64_add_builtin, "i64-add")                                                \
+  X(u8_add_builtin, "u8-add")                                                  \
+  X(u16_add_builtin, "u16-add")                                                \
+  X(u32_add_builtin, "u32-add")                                                \
+  X(u64_add_builtin, "u64-add")                                                \
+  X(i8_sub_builtin, "i8-sub")                                                  \
+  X(i16_sub_builtin, "i16-sub")                                                \
+  X(i32_sub_builtin, "i32-sub")                                                \
+  X(i64_sub_builtin, "i64-sub")                                                \
+  X(u8_sub_builtin, "u8-sub")                                                  \
+  X(u16_sub_builtin, "u16-sub")                                                \
+  X(u32_sub_builtin, "u32-sub")                                                \
+  X(u64_sub_builtin, "u64-sub")                                                \
+  X(i8_mul_builtin, "i8-mul")                                                  \
+  X(i16_mul_builtin, "i16-mul")                                                \
+  X(i32_mul_builtin, "i32-mul")                                                \
+  X(i64_mul_builtin, "i64-mul")                                                \
+  X(u8_mul_builtin, "u8-mul")                                                  \
+  X(u16_mul_builtin, "u16-mul")                                                \
+  X(u32_mul_builtin, "u32-mul")                                                \
+  X(u64_mul_builtin, "u64-mul")                                                \
+  X(i8_div_builtin, "i8-div")                                                  \
+  X(i16_div_builtin, "i16-div")                                                \
+  X(i32_div_builtin, "i32-div")                                                \
+  X(i64_div_builtin, "i64-div")                                                \
+  X(u8_div_builtin, "u8-div")                                                  \
+  X(u16_div_builtin, "u16-div")                                                \
+  X(u32_div_builtin, "u32-div")                                                \
+  X(u64_div_builtin, "u64-div")                                                \
+  X(i8_rem_builtin, "i8-rem")                                                  \
+  X(i16_rem_builtin, "i16-rem")                                                \
+  X(i32_rem_builtin, "i32-rem")                                                \
+  X(i64_rem_builtin, "i64-rem")                                                \
+  X(u8_rem_builtin, "u8-rem")                                                  \
+  X(u16_rem_builtin, "u16-rem")                                                \
+  X(u32_rem_builtin, "u32-rem")                                                \
+  X(u64_rem_builtin, "u64-rem")                                                \
+  X(i8_mod_builtin, "i8-mod")                                                  \
+  X(i16_mod_builtin, "i16-mod")                                                \
+  X(i32_mod_builtin, "i32-mod")                                                \
+  X(i64_mod_builtin, "i64-mod")
+
+// Builtins are looked up in perfect hash tables, which gen_builtin_hash
+// builds from the lists above. A name's hash picks a bucket, and the bucket's
+// seed picks the name's slot.
+u32 builtin_name_hash(const char *name, size_t len);
+u32 builtin_name_slot(u32 hash, u8 seed);
@@ -2,7 +2,11 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <string.h>
+
 #include "assert.h"
+#include "builtin_hash.h"
+#include "builtin_names.h"
 #include "builtins.h"
 #include "consts.h"
 #include "types.h"
@@ -18,16 +22,11 @@
 // * macros in builtins.h
 
 const char *builtin_type_names[] = {
-  [bool_type_ind] = "Bool",
-  [u8_type_ind] = "U8",
-  [u16_type_ind] = "U16",
-  [u32_type_ind] = "U32",
-  [u64_type_ind] = "U64",
-  [i8_type_ind] = "I8",
-  [i16_type_ind] = "I16",
-  [i32_type_ind] = "I32",
-  [i64_type_ind] = "I64",
-  [string_type_ind] = "String",
+
+#define X(ind, name) [ind] = name,
+  DECL_BUILTIN_TYPE_NAMES
+#undef X
+
 };
 
 enum {
@@ -246,70 +245,11 @@ const type builtin_types[] = {
 const node_ind_t builtin_type_amount = STATIC_LEN(builtin_types);
 
 const char *builtin_term_names[builtin_term_amount] = {
-  [true_builtin] = "True",        [false_builtin] = "False",
-
-  [i8_eq_builtin] = "i8-eq?",     [i16_eq_builtin] = "i16-eq?",
-  [i32_eq_builtin] = "i32-eq?",   [i64_eq_builtin] = "i64-eq?",
-
-  [u8_eq_builtin] = "u8-eq?",     [u16_eq_builtin] = "u16-eq?",
-  [u32_eq_builtin] = "u32-eq?",   [u64_eq_builtin] = "u64-eq?",
-
-  [i8_gt_builtin] = "i8-gt?",     [i16_gt_builtin] = "i16-gt?",
-  [i32_gt_builtin] = "i32-gt?",   [i64_gt_builtin] = "i64-gt?",
-
-  [u8_gt_builtin] = "u8-gt?",     [u16_gt_builtin] = "u16-gt?",
-  [u32_gt_builtin] = "u32-gt?",   [u64_gt_builtin] = "u64-gt?",
-
-  [i8_gte_builtin] = "i8-gte?",   [i16_gte_builtin] = "i16-gte?",
-  [i32_gte_builtin] = "i32-gte?", [i64_gte_builtin] = "i64-gte?",
-
-  [u8_gte_builtin] = "u8-gte?",   [u16_gte_builtin] = "u16-gte?",
-  [u32_gte_builtin] = "u32-gte?", [u64_gte_builtin] = "u64-gte?",
-
-  [i8_lt_builtin] = "i8-lt?",     [i16_lt_builtin] = "i16-lt?",
-  [i32_lt_builtin] = "i32-lt?",   [i64_lt_builtin] = "i64-lt?",
-
-  [u8_lt_builtin] = "u8-lt?",     [u16_lt_builtin] = "u16-lt?",
-  [u32_lt_builtin] = "u32-lt?",   [u64_lt_builtin] = "u64-lt?",
-
-  [i8_lte_builtin] = "i8-lte?",   [i16_lte_builtin] = "i16-lte?",
-  [i32_lte_builtin] = "i32-lte?", [i64_lte_builtin] = "i64-lte?",
 
-  [u8_lte_builtin] = "u8-lte?",   [u16_lte_builtin] = "u16-lte?",
-  [u32_lte_builtin] = "u32-lte?", [u64_lte_builtin] = "u64-lte?",
+#define X(ind, name) [ind] = name,
+  DECL_BUILTIN_TERM_NAMES
+#undef X
 
-  [i8_add_builtin] = "i8-add",    [i16_add_builtin] = "i16-add",
-  [i32_add_builtin] = "i32-add",  [i64_add_builtin] = "i64-add",
-
-  [u8_add_builtin] = "u8-add",    [u16_add_builtin] = "u16-add",
-  [u32_add_builtin] = "u32-add",  [u64_add_builtin] = "u64-add",
-
-  [i8_sub_builtin] = "i8-sub",    [i16_sub_builtin] = "i16-sub",
-  [i32_sub_builtin] = "i32-sub",  [i64_sub_builtin] = "i64-sub",
-
-  [u8_sub_builtin] = "u8-sub",    [u16_sub_builtin] = "u16-sub",
-  [u32_sub_builtin] = "u32-sub",  [u64_sub_builtin] = "u64-sub",
-
-  [i8_mul_builtin] = "i8-mul",    [i16_mul_builtin] = "i16-mul",
-  [i32_mul_builtin] = "i32-mul",  [i64_mul_builtin] = "i64-mul",
-
-  [u8_mul_builtin] = "u8-mul",    [u16_mul_builtin] = "u16-mul",
-  [u32_mul_builtin] = "u32-mul",  [u64_mul_builtin] = "u64-mul",
-
-  [i8_div_builtin] = "i8-div",    [i16_div_builtin] = "i16-div",
-  [i32_div_builtin] = "i32-div",  [i64_div_builtin] = "i64-div",
-
-  [u8_div_builtin] = "u8-div",    [u16_div_builtin] = "u16-div",
-  [u32_div_builtin] = "u32-div",  [u64_div_builtin] = "u64-div",
-
-  [i8_rem_builtin] = "i8-rem",    [i16_rem_builtin] = "i16-rem",
-  [i32_rem_builtin] = "i32-rem",  [i64_rem_builtin] = "i64-rem",
-
-  [u8_rem_builtin] = "u8-rem",    [u16_rem_builtin] = "u16-rem",
-  [u32_rem_builtin] = "u32-rem",  [u64_rem_builtin] = "u64-rem",
-
-  [i8_mod_builtin] = "i8-mod",    [i16_mod_builtin] = "i16-mod",
-  [i32_mod_builtin] = "i32-mod",  [i64_mod_builtin] = "i64-mod",
 };
 
 enum {
@@ -503,3 +443,32 @@ const type_ref builtin_type_inds[builtin_type_ind_amount_enum] = {
   [any_int_type_ind_start + 6] = u32_type_ind,
   [any_int_type_ind_start + 7] = u64_type_ind,
 };
+
+// For a known-length, and a null-terminated string
+static bool builtin_name_eq(const char *name, size_t len, const char *builtin) {
+  return strncmp(name, builtin, len) == 0 && builtin[len] == '\0';
+}
+
+type_ref lookup_builtin_type(const char *name, size_t len) {
+  const u32 hash = builtin_name_hash(name, len);
+  const u8 seed =
+    builtin_type_hash_seeds[hash & (BUILTIN_TYPE_HASH_BUCKETS - 1)];
+  const u8 ind = builtin_type_hash_slots[builtin_name_slot(hash, seed) &
+                                         (BUILTIN_TYPE_HASH_SLOTS - 1)];
+  return ind != BUILTIN_EMPTY_SLOT &&
+             builtin_name_eq(name, len, builtin_type_names[ind])
+           ? ind
+           : named_builtin_type_amount;
+}
+
+builtin_term lookup_builtin_term(const char *name, size_t len) {
+  const u32 hash = builtin_name_hash(name, len);
+  const u8 seed =
+    builtin_term_hash_seeds[hash & (BUILTIN_TERM_HASH_BUCKETS - 1)];
+  const u8 ind = builtin_term_hash_slots[builtin_name_slot(hash, seed) &
+                                         (BUILTIN_TERM_HASH_SLOTS - 1)];
+  return ind != BUILTIN_EMPTY_SLOT &&
+             builtin_name_eq(name, len, builtin_term_names[ind])
+           ? ind
+           : builtin_term_amount;
+}
@@ -166,6 +166,12 @@ extern const type_ref builtin_type_inds[];
 extern const type_ref builtin_type_ind_amount;
 extern const char *builtin_term_names[];
 
+// Look a name up in the builtins' perfect hash tables. These return
+// named_builtin_type_amount, and builtin_term_amount, for names that aren't
+// builtins.
+type_ref lookup_builtin_type(const char *name, size_t len);
+builtin_term lookup_builtin_term(const char *name, size_t len);
+
 #define EACH_BUILTIN_BITWIDTH_CASE(prefix, suffix)                             \
   prefix##8##suffix : case prefix##16##suffix : case prefix##32##suffix        \
     : case prefix##64##suffix
@@ -7,14 +7,34 @@
 #include <stdint.h>
 #include <inttypes.h>
 
-#define PRBI PRId32
 #define ERROR_LINES_CTX 2
 
 // TODO move to typedefs.h?
+#ifdef NARROW_INDICES
+// For small units, like REPL entries and tests. Sources are limited to 64KiB,
+// which keeps token, node, and type indices within 16 bits too, and halves
+// the size of most of the compiler's arrays.
+#define PRBI PRIu16
+typedef uint16_t buf_ind_t;
+#define BUF_IND_MAX UINT16_MAX
+typedef uint16_t node_ind_t;
+#define NODE_IND_BITS 16
+#define NODE_IND_MAX UINT16_MAX
+typedef uint16_t environment_ind_t;
+#else
+#define PRBI PRIu32
 typedef uint32_t buf_ind_t;
-typedef uint16_t token_len_t;
+#define BUF_IND_MAX UINT32_MAX
 typedef uint32_t node_ind_t;
+#define NODE_IND_BITS 32
+#define NODE_IND_MAX UINT32_MAX
 typedef uint32_t environment_ind_t;
+#endif
+typedef uint16_t token_len_t;
+
+// The longest source we accept. EOF's position has to fit in a buf_ind_t,
+// and so does the position just past it.
+#define SOURCE_LEN_MAX ((buf_ind_t)(BUF_IND_MAX - 1))
 
 extern const char *const program_name;
 extern const char path_sep;
@@ -8,28 +8,11 @@
 
 #include "consts.h"
 #include "diagnostic.h"
+#include "line_index.h"
 #include "parse_tree.h"
 #include "source.h"
 #include "term.h"
 #include "util.h"
-#include "vec.h"
-
-typedef struct {
-  buf_ind_t start;
-  buf_ind_t end;
-} line;
-
-NON_NULL_PARAMS
-static vec_buf_ind get_line_starts(const char *restrict input, size_t len) {
-  vec_buf_ind line_starts = VEC_NEW;
-  VEC_PUSH(&line_starts, 0);
-  for (buf_ind_t i = 0; i < len; i++) {
-    if (input[i] == '\n') {
-      VEC_PUSH(&line_starts, i + 1);
-    }
-  }
-  return line_starts;
-}
 
 typedef enum {
   S_BEFORE,
@@ -37,41 +20,17 @@ typedef enum {
   S_AFTER,
 } print_state;
 
-position_info find_line_and_col(const char *restrict input, buf_ind_t target) {
-  position_info res = {
-    .line = 1,
-    .column = 1,
-  };
-  for (buf_ind_t i = 0; i < target; i++) {
-    char c = input[i];
-    if (HEDLEY_PREDICT_FALSE(c == '\n', 0.9)) {
-      res.line++;
-      res.column = 1;
-    } else {
-      res.column++;
-    }
-  }
-  return res;
-}
-
-void format_error_ctx(FILE *f, const char *restrict input, buf_ind_t start,
+void format_error_ctx(FILE *f, const line_index *lines, buf_ind_t start,
                       buf_ind_t len) {
-  size_t buf_len = strlen(input);
+  const char *restrict input = lines->data;
+  size_t buf_len = lines->len;
   size_t reset_pos = start + len;
-  vec_buf_ind line_starts = get_line_starts(input, buf_len);
-  int64_t ind_of_line_starting_before_start = 0;
-
-  for (unsigned i = 0; i < line_starts.len; i++) {
-    buf_ind_t a = line_starts.data[i];
-    if (a <= start) {
-      ind_of_line_starting_before_start = i;
-    }
-  }
+  int64_t ind_of_line_starting_before_start = find_line(lines, start);
 
   fputs(RED "/---\n| " RESET, f);
   buf_ind_t context_start =
-    line_starts
-      .data[MAX(ind_of_line_starting_before_start - ERROR_LINES_CTX, 0)];
+    lines->line_starts[MAX(ind_of_line_starting_before_start - ERROR_LINES_CTX,
+                           0)];
 
   print_state state = S_BEFORE;
   buf_ind_t nls_after = 0;
@@ -111,19 +70,27 @@ void format_error_ctx(FILE *f, const char *restrict input, buf_ind_t start,
     }
   }
   fputs("\n" RED "\\---" RESET, f);
-  VEC_FREE(&line_starts);
 }
 
-void print_resolution_errors(FILE *f, const char *restrict input,
+void print_tokens_error(FILE *f, const line_index *lines, tokens_res tres) {
+  if (tres.too_long) {
+    fprintf(f, "Source size can't exceed %" PRBI, SOURCE_LEN_MAX);
+    return;
+  }
+  fputs("Tokenization failed:\n\n", f);
+  format_error_ctx(f, lines, tres.error_pos, 1);
+}
+
+void print_resolution_errors(FILE *f, const line_index *lines,
                              resolution_errors errs) {
   for (node_ind_t i = 0; i < errs.binding_amt; i++) {
     binding b = errs.bindings[i];
-    position_info pos = find_line_and_col(input, b.start);
+    position_info pos = find_line_and_col(lines, b.start);
     fprintf(f,
             "%sUnknown binding '%.*s' at %u:%u",
             i == 0 ? "" : "\n",
             b.len,
-            input + b.start,
+            lines->data + b.start,
             pos.line,
             pos.column);
   }
@@ -133,7 +100,9 @@ char *print_resolution_errors_string(const char *restrict input,
                                      resolution_errors errs) {
   stringstream ss;
   ss_init_immovable(&ss);
-  print_resolution_errors(ss.stream, input, errs);
+  line_index lines = build_line_index(input);
+  print_resolution_errors(ss.stream, &lines, errs);
+  free_line_index(lines);
   ss_finalize(&ss);
   return ss.string;
 }
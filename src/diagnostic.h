@@ -7,19 +7,17 @@
 #include <stdio.h>
 
 #include "consts.h"
+#include "line_index.h"
 #include "parse_tree.h"
 #include "resolve_scope.h"
-
-typedef struct {
-  buf_ind_t line;
-  buf_ind_t column;
-} position_info;
+#include "token.h"
 
 // start end length of highlighted segment of code
-void format_error_ctx(FILE *f, const char *data, buf_ind_t start,
+void format_error_ctx(FILE *f, const line_index *lines, buf_ind_t start,
                       buf_ind_t len);
-position_info find_line_and_col(const char *restrict input, buf_ind_t target);
-void print_resolution_errors(FILE *f, const char *restrict input,
+// Why the source couldn't be scanned
+void print_tokens_error(FILE *f, const line_index *lines, tokens_res tres);
+void print_resolution_errors(FILE *f, const line_index *lines,
                              resolution_errors errs);
 char *print_resolution_errors_string(const char *restrict input,
                                      resolution_errors errs);
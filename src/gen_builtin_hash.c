@@ -0,0 +1,183 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Run at build time, to write the perfect hash tables that builtins are
+// looked up in. Usage: gen-builtin-hash <output header>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin_names.h"
+
+#define EMPTY_SLOT 0xff
+#define MAX_SLOTS 1024
+
+static const char *type_names[] = {
+#define X(ind, name) name,
+  DECL_BUILTIN_TYPE_NAMES
+#undef X
+};
+
+static const char *term_names[] = {
+#define X(ind, name) name,
+  DECL_BUILTIN_TERM_NAMES
+#undef X
+};
+
+typedef struct {
+  unsigned bucket_amt;
+  unsigned slot_amt;
+  u8 seeds[MAX_SLOTS / 2];
+  u8 slots[MAX_SLOTS];
+} hash_table;
+
+static u32 name_hash(const char *name) {
+  return builtin_name_hash(name, strlen(name));
+}
+
+// Places a bucket's names, if there's a seed that puts them all in free slots
+static bool place_bucket(hash_table *table, const char **names,
+                         unsigned name_amt, unsigned bucket) {
+  for (unsigned seed = 0; seed <= 0xff; seed++) {
+    bool ok = true;
+    for (unsigned i = 0; i < name_amt && ok; i++) {
+      const u32 hash = name_hash(names[i]);
+      if ((hash & (table->bucket_amt - 1)) != bucket) {
+        continue;
+      }
+      const u32 slot = builtin_name_slot(hash, seed) & (table->slot_amt - 1);
+      if (table->slots[slot] == EMPTY_SLOT) {
+        table->slots[slot] = i;
+      } else {
+        ok = false;
+      }
+    }
+    if (ok) {
+      table->seeds[bucket] = seed;
+      return true;
+    }
+    // undo this seed's placements
+    for (unsigned i = 0; i < table->slot_amt; i++) {
+      if (table->slots[i] != EMPTY_SLOT &&
+          (name_hash(names[table->slots[i]]) & (table->bucket_amt - 1)) ==
+            bucket) {
+        table->slots[i] = EMPTY_SLOT;
+      }
+    }
+  }
+  return false;
+}
+
+// Hash and displace. The biggest buckets are the hardest to place, so they
+// go first.
+static bool try_build(hash_table *table, const char **names,
+                      unsigned name_amt) {
+  unsigned bucket_sizes[MAX_SLOTS / 2] = {0};
+  for (unsigned i = 0; i < name_amt; i++) {
+    bucket_sizes[name_hash(names[i]) & (table->bucket_amt - 1)]++;
+  }
+  memset(table->seeds, 0, sizeof(table->seeds));
+  memset(table->slots, EMPTY_SLOT, sizeof(table->slots));
+  for (unsigned size = name_amt; size > 0; size--) {
+    for (unsigned bucket = 0; bucket < table->bucket_amt; bucket++) {
+      if (bucket_sizes[bucket] == size &&
+          !place_bucket(table, names, name_amt, bucket)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool build(hash_table *table, const char **names, unsigned name_amt) {
+  for (table->slot_amt = 2; table->slot_amt <= MAX_SLOTS;
+       table->slot_amt *= 2) {
+    if (table->slot_amt < name_amt) {
+      continue;
+    }
+    table->bucket_amt = table->slot_amt / 2;
+    if (try_build(table, names, name_amt)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void write_table(FILE *f, const char *prefix, const char *upper_prefix,
+                        const hash_table *table) {
+  fprintf(f,
+          "#define BUILTIN_%s_HASH_BUCKETS %u\n"
+          "#define BUILTIN_%s_HASH_SLOTS %u\n\n",
+          upper_prefix,
+          table->bucket_amt,
+          upper_prefix,
+          table->slot_amt);
+  fprintf(f,
+          "static const u8 builtin_%s_hash_seeds[BUILTIN_%s_HASH_BUCKETS] = "
+          "{\n",
+          prefix,
+          upper_prefix);
+  for (unsigned i = 0; i < table->bucket_amt; i++) {
+    fprintf(f, "  %u,\n", table->seeds[i]);
+  }
+  fputs("};\n\n", f);
+  fprintf(f,
+          "static const u8 builtin_%s_hash_slots[BUILTIN_%s_HASH_SLOTS] = {\n",
+          prefix,
+          upper_prefix);
+  for (unsigned i = 0; i < table->slot_amt; i++) {
+    fprintf(f, "  %u,\n", table->slots[i]);
+  }
+  fputs("};\n\n", f);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fputs("Usage: gen-builtin-hash <output header>\n", stderr);
+    return 1;
+  }
+  const unsigned type_amt = sizeof(type_names) / sizeof(type_names[0]);
+  const unsigned term_amt = sizeof(term_names) / sizeof(term_names[0]);
+  if (type_amt >= EMPTY_SLOT || term_amt >= EMPTY_SLOT) {
+    fputs("Too many builtins for u8 slots\n", stderr);
+    return 1;
+  }
+  static hash_table types;
+  static hash_table terms;
+  if (!build(&types, type_names, type_amt) ||
+      !build(&terms, term_names, term_amt)) {
+    fputs("Couldn't build a perfect hash of builtin names\n", stderr);
+    return 1;
+  }
+
+  // Written to the side, and moved into place, so that the build never sees
+  // half a header
+  const char *path = argv[1];
+  const size_t path_len = strlen(path);
+  char *tmp_path = malloc(path_len + sizeof(".tmp"));
+  memcpy(tmp_path, path, path_len);
+  memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+  FILE *f = fopen(tmp_path, "w");
+  if (f == NULL) {
+    perror(tmp_path);
+    free(tmp_path);
+    return 1;
+  }
+  fprintf(f,
+          "// Generated by gen_builtin_hash, from builtin_names.h\n\n"
+          "#pragma once\n\n"
+          "#include \"typedefs.h\"\n\n"
+          "#define BUILTIN_EMPTY_SLOT %u\n\n",
+          EMPTY_SLOT);
+  write_table(f, "type", "TYPE", &types);
+  write_table(f, "term", "TERM", &terms);
+  const bool ok = fclose(f) == 0 && rename(tmp_path, path) == 0;
+  if (!ok) {
+    perror(path);
+  }
+  free(tmp_path);
+  return ok ? 0 : 1;
+}
@@ -8,6 +8,8 @@
 
 #include "hashers.h"
 #include "resolve_scope.h"
+#include "share_subtrees.h"
+#include "symbol_table.h"
 #include "types.h"
 
 /*
@@ -84,10 +86,6 @@ static hash_t hash_bytes(hash_t seed, const uint8_t *restrict bytes,
   return seed;
 }
 
-static hash_t hash_string(hash_t seed, const char *str) {
-  return hash_bytes(seed, (uint8_t *)str, strlen(str));
-}
-
 #define hash_primitive(seed, val)                                              \
   (sizeof(val) <= sizeof(hash_t)                                               \
      ? hash_hash_t_bytes(seed, (val))                                          \
@@ -125,12 +123,22 @@ hash_t hash_binding(const void *binding_p, const void *ctx_p) {
 hash_t hash_stored_binding(const void *binding_ind_p, const void *ctx_p) {
   const node_ind_t bnd_ind = *((node_ind_t *)binding_ind_p);
   const resolve_map_ctx ctx = *((resolve_map_ctx *)ctx_p);
-  str_ref sref = VEC_GET(ctx.scope->bindings, bnd_ind);
-  return bs_get(ctx.scope->is_builtin, bnd_ind)
-           ? hash_string(INITIAL_SEED, sref.builtin)
-           : hash_bytes(INITIAL_SEED,
-                        (u8 *)ctx.source_file + sref.binding.start,
-                        sref.binding.len);
+  const binding bnd = VEC_GET(ctx.scope->bindings, bnd_ind);
+  return hash_bytes(INITIAL_SEED, (u8 *)ctx.source_file + bnd.start, bnd.len);
+}
+
+hash_t hash_symbol(const void *key_p, const void *ctx_p) {
+  (void)ctx_p;
+  const symbol_key key = *((symbol_key *)key_p);
+  return hash_bytes(INITIAL_SEED, (u8 *)key.str, key.len);
+}
+
+hash_t hash_stored_symbol(const void *sym_p, const void *ctx_p) {
+  const symbol_id sym = *((symbol_id *)sym_p);
+  const symbol_table *table = (symbol_table *)ctx_p;
+  return hash_bytes(INITIAL_SEED,
+                    (u8 *)symbol_name(table, sym),
+                    symbol_len(table, sym));
 }
 
 hash_t hash_stored_type(const void *key_p, const void *ctx_p) {
@@ -157,3 +165,47 @@ hash_t hash_stored_type(const void *key_p, const void *ctx_p) {
   }
   return hash;
 }
+
+hash_t hash_parse_node(const void *node_ind_p, const void *ctx_p) {
+  const node_ind_t node_ind = *((node_ind_t *)node_ind_p);
+  const share_subtrees_ctx *ctx = (share_subtrees_ctx *)ctx_p;
+  const parse_tree tree = *ctx->tree;
+  const u8 tag = tree.tags[node_ind];
+  const parse_node_data data = PT_NODE_DATA(tree, node_ind);
+  hash_t hash = hash_primitive(INITIAL_SEED, tag);
+  switch (tag) {
+    case PT_ALL_TY_CONSTRUCTOR_NAME:
+      hash = hash_primitive(hash, data.var_data.symbol);
+      return hash_primitive(hash, data.var_data.variable_index);
+    case PT_ALL_EX_STRING:
+    case PT_ALL_PAT_STRING: {
+      const span span = PT_LEAF_SPAN(tree, node_ind);
+      return hash_bytes(hash, (u8 *)ctx->input + span.start, span.len);
+    }
+    default:
+      break;
+  }
+  switch (pt_subs_type[tag]) {
+    case SUBS_NONE:
+      break;
+    case SUBS_ONE:
+      hash = hash_primitive(hash, data.one_sub.ind);
+      break;
+    case SUBS_TWO:
+      hash = hash_primitive(hash, data.two_subs.a);
+      hash = hash_primitive(hash, data.two_subs.b);
+      break;
+    case SUBS_EXTERNAL:
+      hash = hash_bytes(hash,
+                        (u8 *)&tree.inds[data.more_subs.start],
+                        data.more_subs.amt * sizeof(node_ind_t));
+      break;
+  }
+  return hash;
+}
+
+uint64_t hash_source(const char *source, uint32_t len) {
+  const hash_t a = hash_bytes(INITIAL_SEED, (u8 *)source, len);
+  const hash_t b = hash_bytes(PRIME_4, (u8 *)source, len);
+  return ((uint64_t)a << 32) ^ b;
+}
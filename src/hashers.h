@@ -14,3 +14,8 @@ hash_t hash_newtype(const void *key_p, const void *ctx_p);
 hash_t hash_stored_type(const void *key_p, const void *ctx_p);
 hash_t hash_binding(const void *binding_p, const void *ctx_p);
 hash_t hash_stored_binding(const void *binding_ind_p, const void *ctx_p);
+hash_t hash_symbol(const void *key_p, const void *ctx_p);
+hash_t hash_stored_symbol(const void *sym_p, const void *ctx_p);
+hash_t hash_parse_node(const void *node_ind_p, const void *ctx_p);
+// Wider than hash_t, as it's used to tell if a file changed between runs
+uint64_t hash_source(const char *source, uint32_t len);
@@ -0,0 +1,136 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "input_stream.h"
+#include "util.h"
+
+#define READ_BLOCK_BYTES (1024 * 1024)
+
+// No token spans a newline, so an open paren at the start of a line always
+// starts a token, and scanning up to one never needs anything after it.
+// Apart from the scanner's lookahead, and its aligned whitespace reads, which
+// this covers.
+#define FRONTIER_SLACK 64
+
+#ifdef MAP_NORESERVE
+#define RESERVE_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE)
+#else
+#define RESERVE_FLAGS (MAP_PRIVATE | MAP_ANONYMOUS)
+#endif
+
+static void *input_stream_reader(void *arg) {
+  input_stream *stream = arg;
+  size_t len = 0;
+  // where to continue looking for form boundaries from
+  size_t searched = 0;
+  buf_ind_t frontier = 0;
+  bool failed = false;
+  bool too_long = false;
+
+  for (;;) {
+    // the last byte has to stay zero, as the NUL terminator
+    size_t room = stream->reserved - 1 - len;
+    if (room == 0) {
+      // we've read one byte more than we accept
+      too_long = true;
+      failed = true;
+      break;
+    }
+    ssize_t amt =
+      read(stream->fd, stream->data + len, MIN(room, READ_BLOCK_BYTES));
+    if (amt < 0) {
+      if (errno == EINTR)
+        continue;
+      failed = true;
+      break;
+    }
+    if (amt == 0)
+      break;
+    len += amt;
+
+    while (searched + FRONTIER_SLACK < len) {
+      size_t search_to = len - FRONTIER_SLACK;
+      const char *nl =
+        memchr(stream->data + searched, '\n', search_to - searched);
+      if (nl == NULL) {
+        searched = search_to;
+        break;
+      }
+      searched = nl - stream->data + 1;
+      if (stream->data[searched] == '(')
+        frontier = searched;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    stream->len = len;
+    stream->frontier = frontier;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+  }
+
+  pthread_mutex_lock(&stream->lock);
+  stream->len = len;
+  stream->done = true;
+  stream->failed = failed;
+  stream->too_long = too_long;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+bool input_stream_start(input_stream *stream, int fd) {
+  // Virtual memory is cheap, and pages we never read into are never backed.
+  // There's room for the longest source we accept, one byte more, so that we
+  // can tell if it's too long, and the NUL.
+  size_t reserved = (size_t)SOURCE_LEN_MAX + 2;
+  char *data = mmap(NULL, reserved, PROT_READ | PROT_WRITE, RESERVE_FLAGS, -1, 0);
+  if (data == MAP_FAILED)
+    return false;
+
+  stream->data = data;
+  stream->reserved = reserved;
+  stream->fd = fd;
+  stream->len = 0;
+  stream->frontier = 0;
+  stream->done = false;
+  stream->failed = false;
+  stream->too_long = false;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->cond, NULL);
+
+  if (pthread_create(&stream->thread, NULL, input_stream_reader, stream) !=
+      0) {
+    pthread_cond_destroy(&stream->cond);
+    pthread_mutex_destroy(&stream->lock);
+    munmap(data, reserved);
+    return false;
+  }
+  return true;
+}
+
+buf_ind_t input_stream_wait(input_stream *stream, buf_ind_t pos) {
+  pthread_mutex_lock(&stream->lock);
+  while (!stream->done && stream->frontier <= pos) {
+    pthread_cond_wait(&stream->cond, &stream->lock);
+  }
+  buf_ind_t res = stream->done ? BUF_IND_MAX : stream->frontier;
+  pthread_mutex_unlock(&stream->lock);
+  return res;
+}
+
+const char *input_stream_finish(input_stream *stream) {
+  pthread_join(stream->thread, NULL);
+  return stream->failed ? NULL : stream->data;
+}
+
+void input_stream_free(input_stream *stream) {
+  pthread_cond_destroy(&stream->cond);
+  pthread_mutex_destroy(&stream->lock);
+  munmap(stream->data, stream->reserved);
+}
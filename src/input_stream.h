@@ -0,0 +1,47 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "consts.h"
+
+// Reads a file descriptor on a background thread, so that the input can be
+// scanned while the rest of it is still arriving.
+//
+// The buffer is reserved up front, and never moves. Bytes past what has been
+// read so far are zero, so once reading finishes, the data is NUL terminated.
+typedef struct {
+  char *data;
+  size_t reserved;
+  int fd;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // protected by `lock`
+  size_t len;
+  buf_ind_t frontier;
+  bool done;
+  bool failed;
+  // the input was longer than SOURCE_LEN_MAX, which also counts as failing
+  bool too_long;
+} input_stream;
+
+// Returns false if the stream couldn't be started, in which case the
+// input should be read some other way.
+bool input_stream_start(input_stream *stream, int fd);
+
+// Blocks until the scanner is allowed to scan at `pos`, and returns the
+// position it may scan up to. Returns BUF_IND_MAX once everything has been
+// read.
+buf_ind_t input_stream_wait(input_stream *stream, buf_ind_t pos);
+
+// Waits for the rest of the input. Returns NULL if reading failed.
+const char *input_stream_finish(input_stream *stream);
+
+// Must come after input_stream_finish
+void input_stream_free(input_stream *stream);
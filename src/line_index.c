@@ -0,0 +1,95 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "line_index.h"
+#include "vec.h"
+
+#if defined(__AVX2__)
+
+#define NL_CHUNK_BYTES 32
+
+// Returns a bitmask with a bit set for each newline
+static uint32_t newline_mask(const char *chunk_start) {
+  const __m256i chunk = _mm256_loadu_si256((const __m256i *)chunk_start);
+  return (uint32_t)_mm256_movemask_epi8(
+    _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')));
+}
+
+#elif defined(__SSE2__)
+
+#define NL_CHUNK_BYTES 16
+
+// Returns a bitmask with a bit set for each newline
+static uint32_t newline_mask(const char *chunk_start) {
+  const __m128i chunk = _mm_loadu_si128((const __m128i *)chunk_start);
+  return (uint32_t)_mm_movemask_epi8(
+    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+}
+
+#endif
+
+line_index build_line_index(const char *restrict data) {
+  const buf_ind_t len = strlen(data);
+  vec_buf_ind line_starts = VEC_NEW;
+  VEC_PUSH(&line_starts, (buf_ind_t)0);
+
+  buf_ind_t i = 0;
+#ifdef NL_CHUNK_BYTES
+  // We stay within the string, so loads don't need to be aligned
+  for (; len - i >= NL_CHUNK_BYTES; i += NL_CHUNK_BYTES) {
+    uint32_t mask = newline_mask(data + i);
+    while (mask != 0) {
+      VEC_PUSH(&line_starts, (buf_ind_t)(i + __builtin_ctz(mask) + 1));
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < len; i++) {
+    if (data[i] == '\n') {
+      VEC_PUSH(&line_starts, (buf_ind_t)(i + 1));
+    }
+  }
+
+  line_index res = {
+    .data = data,
+    .line_amt = line_starts.len,
+    .len = len,
+  };
+  res.line_starts = VEC_FINALIZE(&line_starts);
+  return res;
+}
+
+void free_line_index(line_index index) { free(index.line_starts); }
+
+buf_ind_t find_line(const line_index *index, buf_ind_t pos) {
+  // last line starting at or before pos
+  buf_ind_t lo = 0;
+  buf_ind_t hi = index->line_amt;
+  while (hi - lo > 1) {
+    buf_ind_t mid = lo + (hi - lo) / 2;
+    if (index->line_starts[mid] <= pos) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+position_info find_line_and_col(const line_index *index, buf_ind_t pos) {
+  buf_ind_t line = find_line(index, pos);
+  position_info res = {
+    .line = line + 1,
+    .column = pos - index->line_starts[line] + 1,
+  };
+  return res;
+}
@@ -0,0 +1,31 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include "consts.h"
+
+typedef struct {
+  buf_ind_t line;
+  buf_ind_t column;
+} position_info;
+
+// Where each line of a source starts. Built once per source, so that each
+// diagnostic can find its position with a binary search, instead of
+// rescanning the source from the start.
+typedef struct {
+  const char *restrict data;
+  // always starts with 0
+  buf_ind_t *line_starts;
+  buf_ind_t line_amt;
+  // length of `data`, excluding the NUL terminator
+  buf_ind_t len;
+} line_index;
+
+line_index build_line_index(const char *restrict data);
+void free_line_index(line_index index);
+// Index of the line containing `pos`, counting from zero
+buf_ind_t find_line(const line_index *index, buf_ind_t pos);
+// Both line and column count from one
+position_info find_line_and_col(const line_index *index, buf_ind_t pos);
@@ -84,7 +84,7 @@ static void llvm_gen_basic_block(llvm_cg_state *state, const char *name,
   LLVMBasicBlockRef block =
     LLVMAppendBasicBlockInContext(state->context, fn, name);
   LLVMPositionBuilderAtEnd(state->builder, block);
-  VEC_PUSH(&state->block_stack, block);
+  VEC_PUSH_RESERVED(&state->block_stack, block);
 }
 
 static LLVMIntPredicate llvm_builtin_predicates[] = {
@@ -211,7 +211,7 @@ static LLVMValueRef llvm_builtin_to_value(llvm_cg_state *state,
   LLVMTypeRef type_ref = llvm_construct_type(state, builtin_type_inds[term]);
   LLVMValueRef fn =
     LLVMAddFunction(state->module, builtin_term_names[term], type_ref);
-  VEC_PUSH(&state->function_stack, fn);
+  VEC_PUSH_RESERVED(&state->function_stack, fn);
 
   llvm_gen_basic_block(state, ENTRY_STR, fn);
 
@@ -366,8 +366,13 @@ static llvm_cg_state llvm_new_cg_state(LLVMContextRef ctx, LLVMModuleRef mod,
       },
   };
 
+  // Every FN and FUN adds a function and a block, and every IF adds two
+  // blocks, as does a builtin that's generated on first use
+  VEC_RESERVE(&state.block_stack, 2 * tree.max_depth + 3);
+  VEC_RESERVE(&state.function_stack, tree.max_depth + 1);
+
   // Sometimes we want to be nowhere
-  VEC_PUSH(&state.block_stack, NULL);
+  VEC_PUSH_RESERVED(&state.block_stack, NULL);
   return state;
 }
 
@@ -379,20 +384,6 @@ static void llvm_init_builtins(llvm_cg_state *state) {
   }
 }
 
-typedef struct {
-  LLVMValueRef left;
-  LLVMValueRef right;
-} tuple_parts;
-
-static tuple_parts llvm_eliminate_tuple(llvm_cg_state *state,
-                                        LLVMValueRef tuple) {
-  tuple_parts res = {
-    .left = LLVMBuildExtractValue(state->builder, tuple, 0, "tuple-left"),
-    .right = LLVMBuildExtractValue(state->builder, tuple, 1, "tuple-right"),
-  };
-  return res;
-}
-
 static void llvm_cg_visit_in(llvm_cg_state *state, traversal_node_data data) {
   switch (data.node.type.all) {
     case PT_ALL_EX_CALL:
@@ -403,7 +394,7 @@ static void llvm_cg_visit_in(llvm_cg_state *state, traversal_node_data data) {
       // We should add this back at some point, I guess
       // LLVMLinkage linkage = LLVMAvailableExternallyLinkage;
       LLVMValueRef fn = LLVMAddFunction(state->module, LAMBDA_STR, fn_type);
-      VEC_PUSH(&state->function_stack, fn);
+      VEC_PUSH_RESERVED(&state->function_stack, fn);
       llvm_gen_basic_block(state, ENTRY_STR, fn);
       break;
     }
@@ -449,9 +440,13 @@ static void llvm_cg_visit_in(llvm_cg_state *state, traversal_node_data data) {
       break;
     case PT_ALL_PAT_TUP: {
       LLVMValueRef val = llvm_pop_exogenous_value(state, &state->return_values);
-      tuple_parts parts = llvm_eliminate_tuple(state, val);
-      llvm_push_exogenous_value(&state->return_values, parts.right);
-      llvm_push_exogenous_value(&state->return_values, parts.left);
+      // the first element's pattern is visited first, so it goes on top
+      for (node_ind_t i = 0; i < PT_TUP_SUB_AMT(data.node); i++) {
+        node_ind_t j = PT_TUP_SUB_AMT(data.node) - 1 - i;
+        LLVMValueRef elem =
+          LLVMBuildExtractValue(state->builder, val, j, "tuple-elem");
+        llvm_push_exogenous_value(&state->return_values, elem);
+      }
       break;
     }
     case PT_ALL_PAT_UNIT:
@@ -486,12 +481,13 @@ static void llvm_cg_visit_in(llvm_cg_state *state, traversal_node_data data) {
     case PT_ALL_STATEMENT_FUN: {
       const node_ind_t binding_ind =
         PT_FUN_BINDING_IND(state->parse_tree.inds, data.node);
-      const parse_node binding = state->parse_tree.nodes[binding_ind];
+      const parse_node_data binding =
+        PT_NODE_DATA(state->parse_tree, binding_ind);
       // we've already predeclared this
       LLVMFunctionRef fn = VEC_GET(state->environment_values.values,
-                                   binding.data.var_data.variable_index)
+                                   binding.var_data.variable_index)
                              .exogenous;
-      VEC_PUSH(&state->function_stack, fn);
+      VEC_PUSH_RESERVED(&state->function_stack, fn);
       llvm_gen_basic_block(state, ENTRY_STR, fn);
       for (node_ind_t i = 0; i < PT_LIST_SUB_AMT(data.node); i++) {
         node_ind_t j = PT_LIST_SUB_AMT(data.node) - 1 - i;
@@ -661,7 +657,7 @@ static void llvm_cg_visit_out(llvm_cg_state *state, traversal_node_data data) {
     case PT_ALL_EX_INT: {
       node_ind_t type_ind = state->types.node_types[data.node_index];
       LLVMTypeRef type = llvm_construct_type(state, type_ind);
-      span span = state->parse_tree.spans[data.node_index];
+      span span = PT_LEAF_SPAN(state->parse_tree, data.node_index);
       const char *str = VEC_GET_PTR(state->source, span.start);
       size_t len = span.len;
       llvm_push_exogenous_value(
@@ -692,18 +688,15 @@ static void llvm_cg_visit_out(llvm_cg_state *state, traversal_node_data data) {
       LLVMValueRef allocated =
         llvm_gen_alloca_at_function_start(state, TUPLE_STR, tup_type);
 
-      LLVMValueRef left_val =
-        llvm_pop_exogenous_value(state, &state->return_values);
-      LLVMValueRef right_val =
-        llvm_pop_exogenous_value(state, &state->return_values);
-
-      LLVMValueRef left_ptr =
-        LLVMBuildStructGEP2(state->builder, tup_type, allocated, 0, TUPLE_STR);
-      LLVMValueRef right_ptr =
-        LLVMBuildStructGEP2(state->builder, tup_type, allocated, 1, TUPLE_STR);
-
-      LLVMBuildStore(state->builder, left_val, left_ptr);
-      LLVMBuildStore(state->builder, right_val, right_ptr);
+      // the last element's value is on top
+      for (node_ind_t i = 0; i < PT_TUP_SUB_AMT(data.node); i++) {
+        node_ind_t j = PT_TUP_SUB_AMT(data.node) - 1 - i;
+        LLVMValueRef val =
+          llvm_pop_exogenous_value(state, &state->return_values);
+        LLVMValueRef ptr = LLVMBuildStructGEP2(
+          state->builder, tup_type, allocated, j, TUPLE_STR);
+        LLVMBuildStore(state->builder, val, ptr);
+      }
 
       LLVMValueRef res = LLVMBuildLoad2(
         state->builder, tup_type, allocated, TUPLE_EXPRESSION_STR);
@@ -749,6 +742,11 @@ static void llvm_cg_visit_out(llvm_cg_state *state, traversal_node_data data) {
 
     case PT_ALL_EX_FN: {
       // TODO implement
+      // The stacks are sized for the tree's depth, so leave them as we
+      // found them
+      VEC_POP_(&state->block_stack);
+      VEC_POP_(&state->function_stack);
+      LLVMPositionBuilderAtEnd(state->builder, VEC_PEEK(state->block_stack));
       break;
     }
   }
@@ -772,7 +770,7 @@ static void llvm_cg_predeclare_fn(llvm_cg_state *state,
     llvm_get_statement_binding_ind(state->parse_tree.inds, data.node);
   const type_ref type_ref = state->types.node_types[data.node_index];
   const LLVMTypeRef fn_type = llvm_construct_type(state, type_ref);
-  span span = state->parse_tree.spans[binding_ind];
+  span span = PT_LEAF_SPAN(state->parse_tree, binding_ind);
 
   // We should add this back at some point, I guess
   // LLVMLinkage linkage = LLVMAvailableExternallyLinkage;
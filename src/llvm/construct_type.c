@@ -72,10 +72,10 @@ LLVMTypeRef llvm_construct_type_internal(LLVMTypeRef *llvm_type_refs, type_tree
           case T_TUP: {
             push_gen_type_action(&actions, COMBINE_TYPE);
             VEC_PUSH(&ind_stack, type_ind);
-            push_gen_type_action(&actions, GEN_TYPE);
-            VEC_PUSH(&ind_stack, T_TUP_SUB_A(t));
-            push_gen_type_action(&actions, GEN_TYPE);
-            VEC_PUSH(&ind_stack, T_TUP_SUB_B(t));
+            for (node_ind_t i = 0; i < T_TUP_SUB_AMT(t); i++) {
+              push_gen_type_action(&actions, GEN_TYPE);
+              VEC_PUSH(&ind_stack, T_TUP_SUB_IND(type_inds, t, i));
+            }
             break;
           }
           case T_FN: {
@@ -114,13 +114,16 @@ LLVMTypeRef llvm_construct_type_internal(LLVMTypeRef *llvm_type_refs, type_tree
             break;
           }
           case T_TUP: {
-            node_ind_t sub_ind_a = T_TUP_SUB_A(t);
-            node_ind_t sub_ind_b = T_TUP_SUB_B(t);
-            LLVMTypeRef subs[2] = {llvm_type_refs[sub_ind_a],
-                                   llvm_type_refs[sub_ind_b]};
+            node_ind_t sub_amt = T_TUP_SUB_AMT(t);
+            size_t n_sub_bytes = sizeof(LLVMTypeRef) * sub_amt;
+            LLVMTypeRef *subs = stalloc(n_sub_bytes);
+            for (node_ind_t i = 0; i < sub_amt; i++) {
+              subs[i] = llvm_type_refs[T_TUP_SUB_IND(type_inds, t, i)];
+            }
             LLVMTypeRef res = LLVMStructCreateNamed(context, "tuple");
-            LLVMStructSetBody(res, subs, 2, false);
+            LLVMStructSetBody(res, subs, sub_amt, false);
             llvm_type_refs[type_ind] = res;
+            stfree(subs, n_sub_bytes);
             break;
           }
           case T_FN: {
@@ -18,7 +18,7 @@ NON_NULL_PARAMS
 HEDLEY_NEVER_INLINE
 HEDLEY_PRINTF_FORMAT(1, 2)
 void log_verbose(const char *restrict fmt, ...) {
-  if (global_settings.verbosity > VERBOSE_SOME) {
+  if (global_settings.verbosity >= VERBOSE_SOME) {
     va_list ap;
     va_start(ap, fmt);
     vprintf(fmt, ap);
@@ -30,7 +30,7 @@ NON_NULL_PARAMS
 HEDLEY_NEVER_INLINE
 HEDLEY_PRINTF_FORMAT(1, 2)
 void log_extra_verbose(const char *restrict fmt, ...) {
-  if (global_settings.verbosity > VERBOSE_VERY) {
+  if (global_settings.verbosity >= VERBOSE_VERY) {
     va_list ap;
     va_start(ap, fmt);
     vprintf(fmt, ap);
@@ -5,6 +5,8 @@
 #include <hedley.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <llvm-c/Core.h>
 #include <llvm-c/Analysis.h>
@@ -12,18 +14,24 @@
 #include <llvm-c/TargetMachine.h>
 
 #include "args.h"
+#include "ast_cache.h"
 #include "diagnostic.h"
-#include "externalise_spans.h"
 #include "global_settings.h"
 #include "initialise.h"
+#include "input_stream.h"
 #include "llvm.h"
+#include "log.h"
+#include "parse_tree_stats.h"
 #include "repl.h"
+#include "share_subtrees.h"
 #include "util.h"
 
 typedef enum { COMMAND_NONE, COMMAND_REPL, COMMAND_COMPILE } subcommand_tag;
 
 static const char *preamble = "Lang v0.1.0 pre-alpha\n";
 
+#define PARALLEL_SCAN_MIN_BYTES (4 * 1024 * 1024)
+
 typedef struct {
   bool verbose;
   bool extra_verbose;
@@ -32,59 +40,175 @@ typedef struct {
 typedef struct {
   bool stdin_input;
   bool no_codegen;
+  bool share_subtrees;
+  bool ast_cache;
   char *input_file_path;
   char *output_file_path;
   char *llvm_dump_path;
 } compile_arguments;
 
+// Shared subtrees have their first occurrence's spans, so we report type
+// errors against a fresh, unshared tree, in the same way that parse_chunked
+// reparses serially when a chunk fails. Returns false if the reparse fails.
+static bool print_unshared_tc_errors(source_file file) {
+  tokens_res tres;
+  parse_tree_res pres = scan_and_parse(file, &tres);
+  free_tokens_res(tres);
+  if (!pres.success) {
+    free_parse_tree_res(pres);
+    return false;
+  }
+  resolution_res res = resolve_bindings(pres.tree, file.data);
+  free(res.not_found.bindings);
+  tc_res tc_res = typecheck(pres.tree);
+  line_index lines = build_line_index(file.data);
+  print_tc_errors(stdout, &lines, pres.tree, tc_res);
+  free_line_index(lines);
+  free_tc_res(tc_res);
+  free_parse_tree_res(pres);
+  return true;
+}
+
+static void compile_parsed(compile_arguments args, source_file file,
+                           tokens_res tres, parse_tree_res pres);
+
 static void compile_llvm(compile_arguments args) {
   const char *restrict source_code;
-  if (args.stdin_input) {
-    source_code = read_entire_file_no_seek(stdin);
+  tokens_res tres;
+  parse_tree_res pres;
+  input_stream stream;
+
+  const bool streamed =
+    args.stdin_input && input_stream_start(&stream, STDIN_FILENO);
+  if (streamed) {
+    // Scan and parse what's arrived so far, while the rest is being read
+    pres = scan_and_parse_stream(&stream, &tres);
+    source_code = input_stream_finish(&stream);
+    if (source_code == NULL) {
+      if (stream.too_long) {
+        fprintf(stderr, "File size can't exceed %" PRBI "\n", SOURCE_LEN_MAX);
+      } else {
+        fputs("Error reading from stdin\n", stderr);
+      }
+      exit(1);
+    }
   } else {
-    // also works if file is /dev/stdin
-    source_code = read_entire_file(args.input_file_path);
+    if (args.stdin_input) {
+      source_code = read_entire_file_no_seek(stdin);
+    } else {
+      // Regular files are mapped, anything else (eg. /dev/stdin) is read
+      source_code = map_entire_file(args.input_file_path).data;
+    }
+    source_file file = {
+      .path = args.input_file_path,
+      .data = source_code,
+    };
+    // The cache goes next to the output, or the input if there isn't one
+    char *cache_path = NULL;
+    if (args.ast_cache && args.input_file_path != NULL) {
+      asprintf(&cache_path,
+               "%s" AST_CACHE_EXTENSION,
+               args.output_file_path != NULL ? args.output_file_path
+                                             : args.input_file_path);
+    }
+    const size_t source_len = strlen(source_code);
+    bool cache_hit = cache_path != NULL &&
+                     load_ast_cache(cache_path, source_code, &pres.tree);
+    if (cache_hit) {
+      // The tokens are only used to build the tree
+      pres.success = true;
+      tres = (tokens_res){.succeeded = true};
+    } else if (source_len >= PARALLEL_SCAN_MIN_BYTES) {
+      // Big enough that scanning and parsing on every core beats streaming
+      tres = scan_all_parallel(file);
+      pres = tres.succeeded ? parse_parallel(tres)
+                            : (parse_tree_res){.success = false};
+    } else {
+      // We never need the tokens, so don't build them
+      pres = scan_and_parse_len(file, source_len, &tres);
+    }
+    if (cache_path != NULL) {
+      if (!cache_hit && pres.success) {
+        write_ast_cache(cache_path, source_code, pres.tree);
+      }
+      ast_cache_stats stats = get_ast_cache_stats();
+      log_verbose(
+        "AST cache: %u hits, %u misses\n", stats.hits, stats.misses);
+      free(cache_path);
+    }
   }
 
   source_file file = {
     .path = args.input_file_path,
     .data = source_code,
   };
+  compile_parsed(args, file, tres, pres);
+  // Codegen has finished with the source
+  if (streamed) {
+    input_stream_free(&stream);
+  }
+}
 
-  tokens_res tres = scan_all(file);
+// Everything after the source has been scanned and parsed
+static void compile_parsed(compile_arguments args, source_file file,
+                           tokens_res tres, parse_tree_res pres) {
+  const char *restrict source_code = file.data;
 
   if (!tres.succeeded) {
-    // TODO extract out to function, share with repl, maybe share with tests?
-    puts("Tokenization failed:\n");
-    format_error_ctx(stdout, source_code, tres.error_pos, 1);
+    line_index lines = build_line_index(source_code);
+    print_tokens_error(stdout, &lines, tres);
+    free_line_index(lines);
     putc('\n', stdout);
     free_tokens_res(tres);
+    free_parse_tree_res(pres);
     return;
   }
 
-  parse_tree_res pres = parse(tres.tokens, tres.token_amt);
   if (!pres.success) {
-    print_parse_errors(stdout, source_code, tres.tokens, pres.errors);
+    line_index lines = build_line_index(source_code);
+    print_parse_errors(stdout, &lines, pres.errors);
+    free_line_index(lines);
     putc('\n', stdout);
+    free_tokens_res(tres);
     free_parse_tree_res(pres);
     return;
   }
 
+  if (global_settings.verbosity >= VERBOSE_SOME) {
+    parse_tree_stats stats = {0};
+    parse_tree_stats_add(&stats, pres.tree);
+    print_parse_tree_stats(stdout, &stats);
+  }
+
   {
     resolution_res res = resolve_bindings(pres.tree, source_code);
     if (res.not_found.binding_amt > 0) {
-      print_resolution_errors(stdout, source_code, res.not_found);
+      line_index lines = build_line_index(source_code);
+      print_resolution_errors(stdout, &lines, res.not_found);
+      free_line_index(lines);
       return;
     }
   }
 
   free_tokens_res(tres);
 
-  externalise_spans(&pres.tree);
+  if (args.share_subtrees) {
+    share_subtrees_res shared = share_subtrees(&pres.tree, source_code);
+    log_verbose("Shared subtrees: removed %u nodes and %u indices, saving "
+                "%zu bytes\n",
+                shared.nodes_removed,
+                shared.inds_removed,
+                shared.bytes_saved);
+  }
 
   tc_res tc_res = typecheck(pres.tree);
   if (tc_res.error_amt > 0) {
-    print_tc_errors(stdout, source_code, pres.tree, tc_res);
+    // If the reparse fails, the shared tree's spans are better than nothing
+    if (!args.share_subtrees || !print_unshared_tc_errors(file)) {
+      line_index lines = build_line_index(source_code);
+      print_tc_errors(stdout, &lines, pres.tree, tc_res);
+      free_line_index(lines);
+    }
     putc('\n', stdout);
     goto end_c;
   }
@@ -156,6 +280,8 @@ int main(const int argc, char **argv) {
   compile_arguments compile_args = {
     .stdin_input = false,
     .no_codegen = false,
+    .share_subtrees = false,
+    .ast_cache = false,
     .input_file_path = NULL,
     .output_file_path = NULL,
     .llvm_dump_path = NULL,
@@ -181,6 +307,19 @@ int main(const int argc, char **argv) {
       .description = "disable generating machine code",
       .data.flag_val = &compile_args.no_codegen,
     },
+    {
+      .tag = ARG_FLAG,
+      .names.long_name = "share-subtrees",
+      .description = "store equal types and literals only once",
+      .data.flag_val = &compile_args.share_subtrees,
+    },
+    {
+      .tag = ARG_FLAG,
+      .names.long_name = "ast-cache",
+      .description = "reuse the parse tree from the last run, if the input "
+                     "hasn't changed",
+      .data.flag_val = &compile_args.ast_cache,
+    },
     {
       .tag = ARG_STRING,
       .names.long_name = "input",
@@ -0,0 +1,252 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parse_tree.h"
+#include "parser.h"
+#include "util.h"
+
+// Below this, starting a thread costs more than parsing the chunk
+#define MIN_CHUNK_TOKENS (64 * 1024)
+
+// Top-level forms don't depend on each other, so we cut the tokens between
+// forms, parse each run of forms on its own thread, and concatenate the trees.
+//
+// The serial parser leaves each top-level form's nodes and indices in one
+// contiguous run, and the root's indices at the very end, so rebasing each
+// chunk's indices by the sizes of the chunks before it gives exactly the
+// serial tree.
+//
+// If any chunk fails, we parse the whole thing again serially, so that errors
+// are reported exactly as they would have been.
+typedef struct {
+  // a view into the full token arrays
+  tokens_res tokens;
+  // only the last chunk has the real EOF
+  bool has_eof;
+  parse_tree_res res;
+  // where the chunk's nodes, non-root indices, and tokens go in the merged
+  // tree
+  node_ind_t node_offset;
+  node_ind_t ind_offset;
+  node_ind_t token_offset;
+} parse_chunk;
+
+static void *parse_chunk_worker(void *arg) {
+  parse_chunk *chunk = arg;
+  chunk->res =
+    chunk->has_eof ? parse(chunk->tokens) : parse_slice(chunk->tokens);
+  return NULL;
+}
+
+// Fills `cuts` with the token indices that chunks 1..chunk_amt-1 start at,
+// and returns how many it found. We only cut before an open paren at depth
+// zero, which starts a top-level form. If the tokens aren't balanced, we might
+// cut in the wrong place, but then some chunk fails, and we reparse serially.
+static unsigned find_cuts(tokens_res tres, size_t *cuts, unsigned chunk_amt) {
+  unsigned cut_amt = 0;
+  size_t target = MAX(tres.token_amt / chunk_amt, 1);
+  int depth = 0;
+  for (size_t i = 0; i < tres.token_amt; i++) {
+    switch (tres.types[i]) {
+      case TK_OPEN_PAREN:
+        if (depth == 0 && i >= target) {
+          cuts[cut_amt++] = i;
+          if (cut_amt + 1 == chunk_amt) {
+            return cut_amt;
+          }
+          target = (uint64_t)tres.token_amt * (cut_amt + 1) / chunk_amt;
+        }
+        depth++;
+        break;
+      case TK_OPEN_BRACKET:
+        depth++;
+        break;
+      case TK_CLOSE_PAREN:
+      case TK_CLOSE_BRACKET:
+        depth--;
+        break;
+      default:
+        break;
+    }
+  }
+  return cut_amt;
+}
+
+static tokens_res slice_tokens(tokens_res tres, size_t begin, size_t end) {
+  tokens_res res = tres;
+  res.starts += begin;
+  res.symbols += begin;
+  res.lens += begin;
+  res.types += begin;
+  res.token_amt = end - begin;
+  res.token_cap = end - begin;
+  return res;
+}
+
+static void rebase_node(parse_node_type_all tag, parse_node_data *data,
+                        node_ind_t node_offset, node_ind_t ind_offset) {
+  switch (pt_subs_type[tag]) {
+    case SUBS_NONE:
+      break;
+    case SUBS_ONE:
+      data->one_sub.ind += node_offset;
+      break;
+    case SUBS_TWO:
+      data->two_subs.a += node_offset;
+      data->two_subs.b += node_offset;
+      break;
+    case SUBS_EXTERNAL:
+      data->more_subs.start += ind_offset;
+      break;
+  }
+}
+
+static parse_tree merge_chunks(parse_chunk *chunks, unsigned chunk_amt) {
+  parse_tree res = {0};
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    parse_tree tree = chunks[i].res.tree;
+    debug_assert(tree.root_subs_start + tree.root_subs_amt == tree.ind_amt);
+    chunks[i].node_offset = res.node_amt;
+    chunks[i].ind_offset = res.root_subs_start;
+    chunks[i].token_offset = res.token_amt;
+    res.node_amt += tree.node_amt;
+    res.token_amt += tree.token_amt;
+    res.ind_amt += tree.ind_amt;
+    // each chunk's root indices come after all its others
+    res.root_subs_start += tree.root_subs_start;
+    res.root_subs_amt += tree.root_subs_amt;
+  }
+  // a chunk's roots have all the later chunks' roots waiting after them, too
+  node_ind_t roots_after = res.root_subs_amt;
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    parse_tree tree = chunks[i].res.tree;
+    roots_after -= tree.root_subs_amt;
+    res.max_depth = MAX(res.max_depth, tree.max_depth + roots_after);
+  }
+  // one allocation, laid out like the serial parser's
+  size_t data_bytes = sizeof(parse_node_data) * res.node_amt;
+  size_t phase_data_bytes = sizeof(parse_node_phase_data) * res.node_amt;
+  size_t inds_bytes = sizeof(node_ind_t) * res.ind_amt;
+  char *buf =
+    malloc(data_bytes + phase_data_bytes + inds_bytes + res.node_amt);
+  res.node_data = (parse_node_data *)buf;
+  res.phase_data = (parse_node_phase_data *)(buf + data_bytes);
+  res.inds = (node_ind_t *)(buf + data_bytes + phase_data_bytes);
+  res.tags = (u8 *)(buf + data_bytes + phase_data_bytes + inds_bytes);
+  // the chunks' tokens are contiguous runs of the full token arrays
+  res.token_starts = malloc(MAX(sizeof(buf_ind_t) * res.token_amt, 1));
+  res.token_lens = malloc(MAX(sizeof(token_len_t) * res.token_amt, 1));
+
+  node_ind_t root_ind = res.root_subs_start;
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    const parse_chunk *chunk = &chunks[i];
+    parse_tree tree = chunk->res.tree;
+    parse_node_data *node_data = res.node_data + chunk->node_offset;
+    u8 *tags = res.tags + chunk->node_offset;
+    memcpy(
+      node_data, tree.node_data, sizeof(parse_node_data) * tree.node_amt);
+    parse_node_phase_data *phase_data = res.phase_data + chunk->node_offset;
+    memcpy(tags, tree.tags, tree.node_amt);
+    for (node_ind_t j = 0; j < tree.node_amt; j++) {
+      rebase_node(
+        tags[j], &node_data[j], chunk->node_offset, chunk->ind_offset);
+      phase_data[j].first_token =
+        tree.phase_data[j].first_token + chunk->token_offset;
+    }
+    memcpy(res.token_starts + chunk->token_offset,
+           tree.token_starts,
+           sizeof(buf_ind_t) * tree.token_amt);
+    memcpy(res.token_lens + chunk->token_offset,
+           tree.token_lens,
+           sizeof(token_len_t) * tree.token_amt);
+    node_ind_t *inds = res.inds + chunk->ind_offset;
+    for (node_ind_t j = 0; j < tree.root_subs_start; j++) {
+      inds[j] = tree.inds[j] + chunk->node_offset;
+    }
+    for (node_ind_t j = 0; j < tree.root_subs_amt; j++) {
+      res.inds[root_ind++] =
+        tree.inds[tree.root_subs_start + j] + chunk->node_offset;
+    }
+  }
+  return res;
+}
+
+parse_tree_res parse_chunked(tokens_res tres, unsigned chunk_amt) {
+  if (chunk_amt <= 1)
+    return parse(tres);
+
+  size_t *cuts = malloc(sizeof(size_t) * (chunk_amt - 1));
+  chunk_amt = find_cuts(tres, cuts, chunk_amt) + 1;
+  if (chunk_amt == 1) {
+    free(cuts);
+    return parse(tres);
+  }
+
+#ifdef TIME_PARSER
+  perf_state perf_state = perf_start();
+#endif
+
+  parse_chunk *chunks = malloc(sizeof(parse_chunk) * chunk_amt);
+  pthread_t *threads = malloc(sizeof(pthread_t) * chunk_amt);
+  bool *spawned = calloc(chunk_amt, sizeof(bool));
+
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    size_t begin = i == 0 ? 0 : cuts[i - 1];
+    size_t end = i + 1 == chunk_amt ? tres.token_amt : cuts[i];
+    chunks[i] = (parse_chunk){
+      .tokens = slice_tokens(tres, begin, end),
+      .has_eof = i + 1 == chunk_amt,
+    };
+  }
+  free(cuts);
+
+  // We parse the first chunk ourselves
+  for (unsigned i = 1; i < chunk_amt; i++) {
+    spawned[i] =
+      pthread_create(&threads[i], NULL, parse_chunk_worker, &chunks[i]) == 0;
+  }
+  parse_chunk_worker(&chunks[0]);
+  bool success = chunks[0].res.success;
+  for (unsigned i = 1; i < chunk_amt; i++) {
+    if (spawned[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      parse_chunk_worker(&chunks[i]);
+    }
+    success &= chunks[i].res.success;
+  }
+
+  parse_tree_res res = {.success = success};
+  if (success) {
+    res.tree = merge_chunks(chunks, chunk_amt);
+  }
+
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    free_parse_tree_res(chunks[i].res);
+  }
+  free(spawned);
+  free(threads);
+  free(chunks);
+
+#ifdef TIME_PARSER
+  // Even when we fall back, so that the counters get closed
+  res.perf_values = perf_end(perf_state);
+#endif
+
+  if (!success) {
+    return parse(tres);
+  }
+  return res;
+}
+
+parse_tree_res parse_parallel(tokens_res tres) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_chunks = tres.token_amt / MIN_CHUNK_TOKENS;
+  unsigned chunk_amt = MIN((size_t)MAX(cores, 1), max_chunks);
+  return parse_chunked(tres, chunk_amt);
+}
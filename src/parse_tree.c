@@ -2,11 +2,14 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <predef/predef.h>
 #include <stdio.h>
+#ifndef PREDEF_OS_WINDOWS
+#include <sys/mman.h>
+#endif
 
 #include "ast_meta.h"
 #include "diagnostic.h"
-#include "bitset.h"
 #include "parse_tree.h"
 #include "traverse.h"
 #include "util.h"
@@ -15,7 +18,6 @@
 typedef enum {
   PRINT_NODE,
   PRINT_STR,
-  POP_TUP_BS,
 } print_action;
 
 VEC_DECL(print_action);
@@ -56,7 +58,6 @@ typedef struct {
   vec_print_action actions;
   vec_node_ind node_stack;
   vec_string string_stack;
-  bitset in_tuple;
   parse_tree tree;
   const char *input;
   FILE *out;
@@ -78,19 +79,6 @@ static void print_source(printer_state *s, span span) {
   fprintf(s->out, "%.*s", span.len, s->input + span.start);
 }
 
-static bool is_tuple(parse_node_type t) {
-  switch (t.all) {
-    case PT_ALL_EX_TUP:
-      return true;
-    case PT_ALL_PAT_TUP:
-      return true;
-    case PT_ALL_TY_TUP:
-      return true;
-    default:
-      return false;
-  }
-}
-
 static void print_separated(printer_state *s, const node_ind_t *restrict inds,
                             node_ind_t amt, const char *sep) {
   for (uint16_t i = 0; i < amt; i++) {
@@ -110,7 +98,6 @@ static void print_compound(printer_state *restrict s,
   vfprintf(s->out, prefix, rest);
   va_end(rest);
 
-  bs_push(&s->in_tuple, is_tuple(node.type));
   switch (pt_subs_type[node.type.all]) {
     case SUBS_NONE:
       break;
@@ -129,8 +116,6 @@ static void print_compound(printer_state *restrict s,
                       sep);
       break;
   }
-  print_action action = POP_TUP_BS;
-  VEC_PUSH(&s->actions, action);
   push_str(s, terminator);
 }
 
@@ -149,9 +134,12 @@ static void print_atom_normal(printer_state *restrict s,
 }
 
 static void print_node(printer_state *s, node_ind_t node_ind) {
-  parse_node node = s->tree.nodes[node_ind];
-  span span =
-    s->tree.spans != NULL ? s->tree.spans[node_ind] : node.phase_data.span;
+  parse_node node = PT_NODE(s->tree, node_ind);
+  // only read for atoms
+  span span = {0};
+  if (pt_subs_type[node.type.all] == SUBS_NONE) {
+    span = PT_LEAF_SPAN(s->tree, node_ind);
+  }
   switch (node.type.all) {
     case PT_ALL_PAT_INT:
     case PT_ALL_EX_INT:
@@ -217,12 +205,7 @@ static void print_node(printer_state *s, node_ind_t node_ind) {
     case PT_ALL_PAT_TUP:
     case PT_ALL_TY_TUP:
     case PT_ALL_EX_TUP:
-      if (bs_peek(&s->in_tuple)) {
-        // right-associated 2-tuples are written as n-tuples
-        print_compound(s, "%s", ", ", "", node, "");
-      } else {
-        print_compound(s, "(", ", ", ")", node);
-      }
+      print_compound(s, "(", ", ", ")", node);
       break;
     case PT_ALL_TY_LIST:
     case PT_ALL_PAT_LIST:
@@ -241,13 +224,11 @@ void print_parse_tree(FILE *f, const char *restrict input, parse_tree tree) {
     .actions = VEC_NEW,
     .node_stack = VEC_NEW,
     .string_stack = VEC_NEW,
-    .in_tuple = bs_new(),
     .tree = tree,
     .input = input,
     .out = f,
   };
 
-  bs_push(&s.in_tuple, false);
   for (node_ind_t i = 0; i < tree.root_subs_amt; i++) {
     node_ind_t ind = tree.root_subs_start + tree.root_subs_amt - 1 - i;
     push_node(&s, tree.inds[ind]);
@@ -287,16 +268,12 @@ void print_parse_tree(FILE *f, const char *restrict input, parse_tree tree) {
                           sizeof(print_action));
         break;
       }
-      case POP_TUP_BS:
-        bs_pop(&s.in_tuple);
-        break;
     }
   }
 
   VEC_FREE(&s.actions);
   VEC_FREE(&s.string_stack);
   VEC_FREE(&s.node_stack);
-  bs_free(&s.in_tuple);
 }
 
 char *print_parse_tree_str(const char *restrict input, const parse_tree tree) {
@@ -307,10 +284,93 @@ char *print_parse_tree_str(const char *restrict input, const parse_tree tree) {
   return ss.string;
 }
 
+// A node with children either has brackets, and ends one token after its last
+// child, or it doesn't, and ends where its last child does. A form's opening
+// bracket is its first token, and comes before its first child's. Nodes
+// without brackets start with their first child, apart from function types in
+// list types, which start with `Fn`. Opening brackets are one byte long, and
+// `Fn` isn't.
+//
+// Leaves are one token long. Empty lists and type parameter lists are `[]`,
+// which is two tokens, or `()`, which is one.
+static node_ind_t pt_last_token(const parse_tree *tree, node_ind_t node) {
+  // brackets we've gone into, which close after the node we end up at
+  node_ind_t closers = 0;
+  for (;;) {
+    parse_node n = PT_NODE(*tree, node);
+    node_ind_t first_token = PT_NODE_FIRST_TOKEN(*tree, node);
+    bool bracket = tree->token_lens[first_token] == 1;
+    node_ind_t first_sub = 0;
+    node_ind_t last_sub = 0;
+    switch (pt_subs_type[n.type.all]) {
+      case SUBS_NONE:
+        return first_token + closers;
+      case SUBS_ONE:
+        first_sub = n.data.one_sub.ind;
+        last_sub = n.data.one_sub.ind;
+        break;
+      case SUBS_TWO:
+        first_sub = n.data.two_subs.a;
+        last_sub = n.data.two_subs.b;
+        break;
+      case SUBS_EXTERNAL:
+        if (n.data.more_subs.amt == 0) {
+          return first_token + closers + (bracket ? 1 : 0);
+        }
+        first_sub = tree->inds[n.data.more_subs.start];
+        last_sub =
+          tree->inds[n.data.more_subs.start + n.data.more_subs.amt - 1];
+        break;
+    }
+    if (bracket && PT_NODE_FIRST_TOKEN(*tree, first_sub) != first_token) {
+      closers++;
+    }
+    node = last_sub;
+  }
+}
+
+node_ind_t *pt_node_subs(parse_node_type_all tag, const parse_node_data *data,
+                         const node_ind_t *inds, node_ind_t *amt) {
+  switch (pt_subs_type[tag]) {
+    case SUBS_NONE:
+      break;
+    case SUBS_ONE:
+      *amt = 1;
+      return (node_ind_t *)&data->one_sub.ind;
+    case SUBS_TWO:
+      *amt = 2;
+      return (node_ind_t *)&data->two_subs.a;
+    case SUBS_EXTERNAL:
+      *amt = data->more_subs.amt;
+      return (node_ind_t *)&inds[data->more_subs.start];
+  }
+  *amt = 0;
+  return NULL;
+}
+
+span pt_node_span(const parse_tree *tree, node_ind_t node) {
+  node_ind_t first_token = PT_NODE_FIRST_TOKEN(*tree, node);
+  node_ind_t last_token = pt_last_token(tree, node);
+  buf_ind_t start = tree->token_starts[first_token];
+  span res = {
+    .start = start,
+    .len =
+      tree->token_starts[last_token] + tree->token_lens[last_token] - start,
+  };
+  return res;
+}
+
 void free_parse_tree(parse_tree tree) {
-  free((void *)tree.inds);
-  free((void *)tree.nodes);
-  free((void *)tree.spans);
+#ifndef PREDEF_OS_WINDOWS
+  if (tree.mapped_bytes > 0) {
+    munmap((void *)tree.node_data, tree.mapped_bytes);
+    return;
+  }
+#endif
+  // `node_data` owns the allocation the other node arrays live in
+  free((void *)tree.node_data);
+  free((void *)tree.token_starts);
+  free((void *)tree.token_lens);
 }
 
 void free_parse_tree_res(parse_tree_res res) {
@@ -321,21 +381,21 @@ void free_parse_tree_res(parse_tree_res res) {
   }
 }
 
-void print_parse_errors(FILE *f, const char *restrict input,
-                        const token *restrict tokens, parse_errors errors) {
+void print_parse_errors(FILE *f, const line_index *lines,
+                        parse_errors errors) {
   fputs("Parsing failed:\n", f);
-  token t = tokens[errors.error_pos];
-  format_error_ctx(f, input, t.start, t.len);
+  format_error_ctx(f, lines, errors.error_span.start, errors.error_span.len);
   fputs("\nExpected one of: ", f);
   print_tokens(f, errors.expected, errors.expected_amt);
 }
 
 char *print_parse_errors_string(const char *restrict input,
-                                const token *restrict tokens,
                                 const parse_tree_res pres) {
   stringstream ss;
   ss_init_immovable(&ss);
-  print_parse_errors(ss.stream, input, tokens, pres.errors);
+  line_index lines = build_line_index(input);
+  print_parse_errors(ss.stream, &lines, pres.errors);
+  free_line_index(lines);
   ss_finalize(&ss);
   return ss.string;
 }
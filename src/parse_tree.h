@@ -11,6 +11,8 @@
 #include "binding.h"
 #include "bitset.h"
 #include "consts.h"
+#include "input_stream.h"
+#include "line_index.h"
 #include "span.h"
 #include "token.h"
 #include "vec.h"
@@ -43,7 +45,7 @@ typedef enum {
   X(EX_LIST, "ListExpression", PT_C_EXPRESSION, SUBS_EXTERNAL) \
   X(EX_STRING, "StringExpression", PT_C_EXPRESSION, SUBS_NONE) \
   X(EX_TERM_NAME, "TermNameExpression", PT_C_EXPRESSION, SUBS_NONE) \
-  X(EX_TUP, "TupleExpression", PT_C_EXPRESSION, SUBS_TWO) \
+  X(EX_TUP, "TupleExpression", PT_C_EXPRESSION, SUBS_EXTERNAL) \
   X(EX_UNIT, "UnitExpression", PT_C_EXPRESSION, SUBS_NONE) \
   X(EX_UPPER_NAME, "ConstructorNameExpression", PT_C_EXPRESSION, SUBS_NONE) \
   X(MULTI_DATA_CONSTRUCTOR_DECL, "DataConstructorDeclaration", PT_C_NONE, SUBS_EXTERNAL) \
@@ -53,12 +55,12 @@ typedef enum {
   X(MULTI_TYPE_CONSTRUCTOR_NAME, "TypeConstructorName", PT_C_NONE, SUBS_NONE) \
   X(MULTI_TYPE_PARAM_NAME, "TypeParamName", PT_C_NONE, SUBS_NONE) \
   X(MULTI_TYPE_PARAMS, "TypeParameters", PT_C_NONE, SUBS_EXTERNAL) \
-  X(PAT_CONSTRUCTION, "DataConstructionPattern", PT_C_PATTERN, SUBS_TWO) \
+  X(PAT_CONSTRUCTION, "DataConstructionPattern", PT_C_PATTERN, SUBS_EXTERNAL) \
   X(PAT_DATA_CONSTRUCTOR_NAME, "DataConstructorName", PT_C_PATTERN, SUBS_NONE) \
   X(PAT_INT, "IntPattern", PT_C_PATTERN, SUBS_NONE) \
-  X(PAT_LIST, "ListPattern", PT_C_PATTERN, SUBS_NONE) \
+  X(PAT_LIST, "ListPattern", PT_C_PATTERN, SUBS_EXTERNAL) \
   X(PAT_STRING, "StringPattern", PT_C_PATTERN, SUBS_NONE) \
-  X(PAT_TUP, "TuplePattern", PT_C_PATTERN, SUBS_TWO) \
+  X(PAT_TUP, "TuplePattern", PT_C_PATTERN, SUBS_EXTERNAL) \
   X(PAT_UNIT, "UnitPattern", PT_C_PATTERN, SUBS_NONE) \
   X(PAT_WILDCARD, "WildcardPattern", PT_C_PATTERN, SUBS_NONE) \
   X(STATEMENT_DATA_DECLARATION, "DataDeclarationStatement", PT_C_STATEMENT, SUBS_EXTERNAL) \
@@ -71,7 +73,7 @@ typedef enum {
   X(TY_FN, "FunctionType", PT_C_TYPE, SUBS_EXTERNAL) \
   X(TY_LIST, "ListType", PT_C_TYPE, SUBS_ONE) \
   X(TY_PARAM_NAME, "TypeVariable", PT_C_TYPE, SUBS_NONE) \
-  X(TY_TUP, "TupleType", PT_C_TYPE, SUBS_TWO) \
+  X(TY_TUP, "TupleType", PT_C_TYPE, SUBS_EXTERNAL) \
   X(TY_UNIT, "UnitType", PT_C_TYPE, SUBS_NONE)
   
 typedef enum {
@@ -82,6 +84,11 @@ DECL_PARSE_NODES
 
 } parse_node_type_all;
 
+// Kept out of parse_node_type_all, so that switches over it stay exhaustive
+#define X(enum_name, str, cat, subs) +1
+enum { parse_node_type_amount = 0 DECL_PARSE_NODES };
+#undef X
+
 VEC_DECL(parse_node_type_all);
 
 typedef enum {
@@ -201,9 +208,8 @@ typedef union {
 
 #define PT_SIG_TYPE_IND(node) (node).data.one_sub.ind
 
-#define PT_TUP_SUB_AMT(node) 2
-#define PT_TUP_SUB_A(node) (node).data.two_subs.a
-#define PT_TUP_SUB_B(node) (node).data.two_subs.b
+#define PT_TUP_SUB_AMT(node) (node).data.more_subs.amt
+#define PT_TUP_SUB_IND(inds, node, i) (inds)[(node).data.more_subs.start + (i)]
 
 #define PT_LET_BND_IND(node) (node).data.two_subs.a
 #define PT_LET_VAL_IND(node) (node).data.two_subs.b
@@ -214,65 +220,88 @@ typedef union {
 extern const char **parse_node_strings;
 extern const parse_node_category *parse_node_categories;
 
+// Written by one phase, for the next. Spans aren't stored at all, see
+// pt_node_span.
+typedef union {
+  // the token each node starts at, set by the parser
+  node_ind_t first_token;
+  struct {
+    node_ind_t type_data_ind : NODE_IND_BITS - 1;
+    // flags
+    node_ind_t c_abi : 1;
+  } post_resolve;
+} parse_node_phase_data;
+
+typedef union {
+  struct {
+    // the name's interned spelling, set by the parser
+    symbol_id symbol;
+    // position of the binding in the current scope
+    // vector
+    environment_ind_t variable_index;
+  } var_data;
+
+  struct {
+    node_ind_t start;
+    node_ind_t amt;
+  } more_subs;
+
+  struct {
+    node_ind_t ind;
+  } one_sub;
+
+  struct {
+    node_ind_t a;
+    node_ind_t b;
+  } two_subs;
+} parse_node_data;
+
+// One node's tag and children, gathered from a tree's arrays by PT_NODE.
+// Its phase data is left behind, as most passes don't want it.
 typedef struct {
   parse_node_type type;
-
-  // TODO use these spare padding bits for something?
-
-  union {
-    // the parser puts this inline, we move it to a separate
-    // array during name resolution, because it won't be very
-    // useful after that.
-    span span;
-    struct {
-      node_ind_t type_data_ind;
-      // flags
-      node_ind_t c_abi : 1;
-    } post_resolve;
-  } phase_data;
-
-  union {
-    struct {
-      // position of the binding in the parse tree
-      // this probably won't be used.
-      node_ind_t variable_node_ind;
-      // position of the binding in the current scope
-      // vector
-      environment_ind_t variable_index;
-    } var_data;
-
-    struct {
-      node_ind_t start;
-      node_ind_t amt;
-    } more_subs;
-
-    struct {
-      node_ind_t ind;
-    } one_sub;
-
-    struct {
-      node_ind_t a;
-      node_ind_t b;
-    } two_subs;
-  } data;
+  parse_node_data data;
 } parse_node;
 
-VEC_DECL(parse_node);
+VEC_DECL(parse_node_data);
+VEC_DECL(parse_node_phase_data);
 
+// Nodes are stored as parallel arrays, so that a pass that only switches on
+// tags doesn't drag children and spans through the cache with them.
 typedef struct {
-  parse_node *nodes;
-  span *spans;
+  // owns the allocation that the other node arrays and `inds` live in
+  parse_node_data *node_data;
+  parse_node_phase_data *phase_data;
+  // parse_node_type_all, one byte each
+  u8 *tags;
   node_ind_t *inds;
+  // Where each token is, so that spans can be rebuilt from the first_tokens
+  // in `phase_data`. Each has its own allocation.
+  buf_ind_t *token_starts;
+  token_len_t *token_lens;
+  node_ind_t token_amt;
   node_ind_t root_subs_start;
   node_ind_t root_subs_amt;
   // this is set even if parsing errored, for benchmarking
   node_ind_t node_amt;
   node_ind_t ind_amt;
+  // The most nodes a depth-first walk has waiting at once, if it pushes all
+  // of a node's children when it visits it: one per level, plus each level's
+  // later siblings. This is at least the nesting depth, so later phases can
+  // size their stacks from it up front.
+  node_ind_t max_depth;
+  // Zero unless the tree was mapped from an AST cache, in which case all of
+  // its arrays live in one mapping, which starts at `node_data`
+  size_t mapped_bytes;
 } parse_tree;
 
 typedef struct {
   token_type *expected;
+  // index of the token we failed on
   node_ind_t error_pos;
+  // position of the token we failed on, so that we can report errors without
+  // keeping the tokens around
+  span error_span;
   uint8_t expected_amt;
 } parse_errors;
 
@@ -283,19 +312,71 @@ typedef struct {
   perf_values perf_values;
 } parse_tree_res;
 
-parse_tree_res parse(token *tokens, size_t token_amt);
+typedef enum {
+  // lemon's own Parse(), one call per token
+  PARSER_DRIVER_LEMON,
+  // our loop over a dense action table, see parser.y
+  PARSER_DRIVER_TABLE,
+} parser_driver;
+
+// Uses the table driver when built with TABLE_DRIVEN_PARSER
+parse_tree_res parse(tokens_res tres);
+// For comparing drivers, both are always built
+parse_tree_res parse_with_driver(tokens_res tres, parser_driver driver);
+// Parses tokens that don't end in EOF, as though they did, eg. a run of
+// top-level forms cut out of a bigger token array
+parse_tree_res parse_slice(tokens_res tres);
+// Splits the tokens into `chunk_amt` runs of top-level forms, and parses them
+// concurrently. Produces the same tree as `parse`.
+parse_tree_res parse_chunked(tokens_res tres, unsigned chunk_amt);
+// `parse_chunked`, with as many chunks as is worthwhile for this machine
+parse_tree_res parse_parallel(tokens_res tres);
+
+// Feeds tokens straight from the scanner to the parser, without materializing
+// a token array. `tres` is filled in, but never contains tokens, only the
+// symbol table. Tokenization
+// stops at the first parse error. Timings are reported as parser timings.
+parse_tree_res scan_and_parse(source_file file, tokens_res *tres);
+// `scan_and_parse`, for when the source's length is already known
+parse_tree_res scan_and_parse_len(source_file file, size_t len,
+                                  tokens_res *tres);
+
+// Like scan_and_parse, but starts on the input while it's still being read.
+// The stream is left to be finished by the caller.
+parse_tree_res scan_and_parse_stream(input_stream *stream, tokens_res *tres);
 
 void print_parse_tree(FILE *f, const char *input, const parse_tree tree);
 char *print_parse_tree_str(const char *input, const parse_tree tree);
-void print_parse_errors(FILE *f, const char *restrict input,
-                                     const token *restrict tokens,
-                                     parse_errors errors);
-char *print_parse_errors_string(const char *input, const token *tokens,
-                                const parse_tree_res pres);
+void print_parse_errors(FILE *f, const line_index *lines,
+                        parse_errors errors);
+char *print_parse_errors_string(const char *input, const parse_tree_res pres);
+// A node's children, as a run of indices, whether they're kept in its data
+// or in `inds`. Like strchr, this points into its arguments, so the result is
+// only writable if they are.
+node_ind_t *pt_node_subs(parse_node_type_all tag, const parse_node_data *data,
+                         const node_ind_t *inds, node_ind_t *amt);
+// Rebuilds a node's span from its tokens. This walks down the node's last
+// children, so it's meant for diagnostics. Use PT_LEAF_SPAN for leaves.
+span pt_node_span(const parse_tree *tree, node_ind_t node);
 void free_parse_tree(parse_tree tree);
 void free_parse_tree_res(parse_tree_res res);
 extern const tree_node_repr *pt_subs_type;
 
+#define PT_NODE_TAG(tree, i) ((parse_node_type_all)(tree).tags[(i)])
+#define PT_NODE_DATA(tree, i) ((tree).node_data[(i)])
+#define PT_NODE_FIRST_TOKEN(tree, i) ((tree).phase_data[(i)].first_token)
+// Only for nodes without children, which are one token long
+#define PT_LEAF_SPAN(tree, i)                                                  \
+  ((struct span){                                                              \
+    .start = (tree).token_starts[PT_NODE_FIRST_TOKEN(tree, i)],                \
+    .len = (tree).token_lens[PT_NODE_FIRST_TOKEN(tree, i)],                    \
+  })
+#define PT_NODE(tree, i)                                                       \
+  ((parse_node){                                                               \
+    .type.all = PT_NODE_TAG(tree, i),                                          \
+    .data = PT_NODE_DATA(tree, i),                                             \
+  })
+
 #define PT_EXPRESSION_CASES                                                    \
   PT_ALL_EX_CALL:                                                              \
   case PT_ALL_EX_FN:                                                           \
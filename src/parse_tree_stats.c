@@ -0,0 +1,131 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <inttypes.h>
+
+#include "parse_tree_stats.h"
+#include "util.h"
+#include "vec.h"
+
+// Some node types print the same, so these are the enum's names
+const char *const pt_stats_type_names[parse_node_type_amount] = {
+
+#define X(name, str, cat, subs) [PARSE_NODE_ALL_PREFIX(name)] = #name,
+  DECL_PARSE_NODES
+#undef X
+
+};
+
+const char *const pt_fan_out_bucket_names[PT_FAN_OUT_BUCKET_AMT] = {
+  "0", "1", "2", "3-4", "5-8", "9-16", "17+",
+};
+
+static unsigned fan_out_bucket(node_ind_t sub_amt) {
+  if (sub_amt <= 2) {
+    return sub_amt;
+  }
+  unsigned res = 3;
+  for (node_ind_t bound = 4;
+       sub_amt > bound && res < PT_FAN_OUT_BUCKET_AMT - 1;
+       bound *= 2) {
+    res++;
+  }
+  return res;
+}
+
+// Node types, sizes, and fan-out come straight from the arrays
+static void add_node_stats(parse_tree_stats *stats, parse_tree tree) {
+  static const size_t node_bytes =
+    sizeof(parse_node_data) + sizeof(parse_node_phase_data) + sizeof(u8);
+  for (node_ind_t i = 0; i < tree.node_amt; i++) {
+    const u8 tag = tree.tags[i];
+    node_ind_t sub_amt;
+    pt_node_subs(tag, &tree.node_data[i], tree.inds, &sub_amt);
+    stats->nodes_by_type[tag]++;
+    stats->bytes_by_type[tag] += node_bytes;
+    if (pt_subs_type[tag] == SUBS_EXTERNAL) {
+      stats->bytes_by_type[tag] += sizeof(node_ind_t) * sub_amt;
+    }
+    stats->fan_out[fan_out_bucket(sub_amt)]++;
+  }
+}
+
+// Depths need a walk, as nodes don't always come after their parents
+static void add_depth_stats(parse_tree_stats *stats, parse_tree tree) {
+  vec_node_ind stack = VEC_NEW;
+  vec_node_ind depths = VEC_NEW;
+  VEC_APPEND(&stack, tree.root_subs_amt, &tree.inds[tree.root_subs_start]);
+  for (node_ind_t i = 0; i < tree.root_subs_amt; i++) {
+    const node_ind_t depth = 1;
+    VEC_PUSH(&depths, depth);
+  }
+  while (stack.len > 0) {
+    node_ind_t node;
+    node_ind_t depth;
+    VEC_POP(&stack, &node);
+    VEC_POP(&depths, &depth);
+    stats->max_depth = MAX(stats->max_depth, depth);
+    stats->depth_sum += depth;
+    stats->nodes_walked++;
+    node_ind_t sub_amt;
+    const node_ind_t *subs = pt_node_subs(
+      PT_NODE_TAG(tree, node), &tree.node_data[node], tree.inds, &sub_amt);
+    VEC_APPEND(&stack, sub_amt, subs);
+    const node_ind_t sub_depth = depth + 1;
+    for (node_ind_t i = 0; i < sub_amt; i++) {
+      VEC_PUSH(&depths, sub_depth);
+    }
+  }
+  VEC_FREE(&stack);
+  VEC_FREE(&depths);
+}
+
+void parse_tree_stats_add(parse_tree_stats *stats, parse_tree tree) {
+  stats->tree_amt++;
+  stats->node_amt += tree.node_amt;
+  stats->inds_bytes += sizeof(node_ind_t) * tree.ind_amt;
+  add_node_stats(stats, tree);
+  add_depth_stats(stats, tree);
+}
+
+double parse_tree_stats_mean_depth(const parse_tree_stats *stats) {
+  return stats->nodes_walked == 0
+           ? 0
+           : (double)stats->depth_sum / (double)stats->nodes_walked;
+}
+
+void print_parse_tree_stats(FILE *f, const parse_tree_stats *stats) {
+  u64 node_bytes = 0;
+  for (unsigned i = 0; i < parse_node_type_amount; i++) {
+    node_bytes += stats->bytes_by_type[i];
+  }
+  fprintf(f,
+          "Parse tree: %" PRIu64 " nodes, %" PRIu64 " bytes with their "
+          "indices, %" PRIu64 " bytes of indices\n",
+          stats->node_amt,
+          node_bytes,
+          stats->inds_bytes);
+  fprintf(f,
+          "Parse tree depth: %" PRIu64 " max, %.3f mean\n",
+          stats->max_depth,
+          parse_tree_stats_mean_depth(stats));
+  fputs("Parse tree fan-out:", f);
+  for (unsigned i = 0; i < PT_FAN_OUT_BUCKET_AMT; i++) {
+    fprintf(f,
+            " %s: %" PRIu64 "%s",
+            pt_fan_out_bucket_names[i],
+            stats->fan_out[i],
+            i == PT_FAN_OUT_BUCKET_AMT - 1 ? "\n" : ",");
+  }
+  for (unsigned i = 0; i < parse_node_type_amount; i++) {
+    if (stats->nodes_by_type[i] == 0) {
+      continue;
+    }
+    fprintf(f,
+            "  %s: %" PRIu64 " nodes, %" PRIu64 " bytes\n",
+            pt_stats_type_names[i],
+            stats->nodes_by_type[i],
+            stats->bytes_by_type[i]);
+  }
+}
@@ -0,0 +1,43 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <stdio.h>
+
+#include "parse_tree.h"
+#include "typedefs.h"
+
+// Children per node: 0, 1, 2, 3-4, 5-8, 9-16, 17+
+#define PT_FAN_OUT_BUCKET_AMT 7
+
+// What a set of trees is made of. Everything is a sum, so stats from several
+// trees can be added together, and nothing depends on them having been
+// shared or not.
+typedef struct {
+  u64 tree_amt;
+  u64 node_amt;
+  u64 nodes_by_type[parse_node_type_amount];
+  // a node's share of the node arrays, plus its run of `inds`
+  u64 bytes_by_type[parse_node_type_amount];
+  u64 inds_bytes;
+  // How deep nodes are nested, with the roots' children at depth one. This
+  // isn't the tree's max_depth, which also counts siblings waiting on a stack.
+  u64 max_depth;
+  u64 depth_sum;
+  // Nodes reached from the roots. Shared nodes are reached once per
+  // reference, so this can be more than node_amt.
+  u64 nodes_walked;
+  u64 fan_out[PT_FAN_OUT_BUCKET_AMT];
+} parse_tree_stats;
+
+extern const char *const pt_stats_type_names[parse_node_type_amount];
+extern const char *const pt_fan_out_bucket_names[PT_FAN_OUT_BUCKET_AMT];
+
+void parse_tree_stats_add(parse_tree_stats *stats, parse_tree tree);
+
+double parse_tree_stats_mean_depth(const parse_tree_stats *stats);
+
+// One line per figure, and per node type that appears
+void print_parse_tree_stats(FILE *f, const parse_tree_stats *stats);
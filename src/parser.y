@@ -1,5 +1,5 @@
 %token_prefix TK_
-%token_type   int // index into token vec
+%token_type   buf_ind_t // the token's index, see token_arrays
 %default_type node_ind_t
 
 // This is so that parser.h changes less
@@ -36,12 +36,32 @@
 %type type_inner_tuple stack_ref_t
 %type toplevels stack_ref_t
 %type block stack_ref_t
-%type int parse_node
-%type string parse_node
-%type unit parse_node
-%type upper_name_node parse_node
-%type lower_name_node parse_node
+%type int pending_node
+%type string pending_node
+%type unit pending_node
 %type param_decls stack_ref_t
+%type open_paren opened_form
+%type open_bracket opened_form
+
+// These get written into the node their opening bracket reserved
+%type toplevel_under pending_node
+%type statement_in_parens pending_node
+%type datatype_decl pending_node
+%type let pending_node
+%type sig pending_node
+%type fun pending_node
+%type fn pending_node
+%type compound_expression pending_node
+%type expression_list_contents pending_node
+%type if pending_node
+%type call pending_node
+%type typed pending_node
+%type tuple pending_node
+%type pattern_in_parens pending_node
+%type pattern_construction pending_node
+%type type_inside_parens_or_tuple pending_node
+%type type_inside_parens pending_node
+%type fn_type pending_node
 
 // TODO replace 'name' with 'ident'
 
@@ -49,11 +69,13 @@
 
   #include <assert.h>
   #include <hedley.h>
+  #include <pthread.h>
+  #include <string.h>
   #include <time.h>
 
   #include "defs.h"
+  #include "input_stream.h"
   #include "parse_tree.h"
-  #include "reorder_tree.h"
   #include "timing.h"
   #include "token.h"
   #include "util.h"
@@ -62,29 +84,75 @@
   #define YYNOERRORRECOVERY 1
   #define YYSTACKDEPTH 0
 
+  // The parse loop only reads token types. Each terminal's minor is its
+  // index, which the few rules that need more, like names, look up here.
   typedef struct {
-    token *tokens;
-    vec_parse_node nodes;
+    const buf_ind_t *starts;
+    const token_len_t *lens;
+    const symbol_id *symbols;
+    size_t amt;
+  } token_arrays;
+
+  typedef struct {
+    // the tree's node arrays, see parse_tree
+    vec_parse_node_data node_data;
+    vec_parse_node_phase_data phase_data;
+    vec_u8 tags;
     vec_node_ind inds;
     node_ind_t root_subs_start;
     node_ind_t root_subs_amt;
     token_type *expected;
     node_ind_t pos;
     node_ind_t error_pos;
+    span error_span;
     uint8_t expected_amt;
-    bool get_expected;
     bool success;
+    // We're parsing a slice of the tokens, which has no EOF of its own
+    bool slice;
     vec_node_ind ind_stack;
+    // For each node, the max_depth of the tree under it. Children are always
+    // finished before their parents, so this is filled in as we go.
+    vec_node_ind depths;
+    node_ind_t max_depth;
+    token_arrays tokens;
+    // The tokens so far, when we're scanning as we go. `tokens` points into
+    // these, and they become the tree's. There's no symbol array then, see
+    // token_symbol.
+    vec_buf_ind token_starts;
+    vec_token_len token_lens;
+    symbol_id recent_symbols[2];
+    // When we know how many tokens there are up front, the node arrays,
+    // `inds`, `ind_stack`, and `depths` are all carved out of this. They move
+    // out if they'd outgrow it, see parse_state_reserve.
+    char *arena;
   } parse_state;
 
   typedef node_ind_t stack_ref_t;
 
+  // A node on its way into the tree, which splits it across its arrays
+  typedef struct {
+    parse_node_type type;
+    // Only read when the node doesn't go into a reserved slot, which already
+    // has its first token
+    node_ind_t first_token;
+    parse_node_data data;
+  } pending_node;
+
   typedef struct {
     node_ind_t a;
     node_ind_t b;
   } node_ind_tup;
 
-  static parse_tree_res parse_internal(token *tokens, size_t token_amt, bool get_expected);
+  // We build the tree in pre-order, by reserving a form's node when we see
+  // its opening bracket, and filling it in when the form gets reduced.
+  typedef struct {
+    node_ind_t ind;
+  } opened_form;
+
+  static parse_tree_res parse_internal(tokens_res tres, parser_driver driver, bool slice);
+  static parse_state parse_state_new(void);
+  static parse_state parse_state_new_arena(size_t token_amt);
+  static parse_tree_res parse_state_finalize(parse_state *state);
 
   #ifndef NDEBUG
     void break_parser(void) {}
@@ -93,43 +161,61 @@
     #define BREAK_PARSER do {} while(0)
   #endif
 
-  static node_ind_t desugar_tuple(parse_state*, parse_node_type_all, stack_ref_t);
-  static node_ind_t push_node(parse_state *s, parse_node node);
+  static void parse_state_leave_arena(parse_state *s);
 
-  static buf_ind_t after_token_end(token t) {
-    return t.start + t.len;
+  // Makes room for `amt` more elements in one of the state's arrays. Arena
+  // arrays can't be realloc'd, so if one would outgrow its slice, they all
+  // move out first.
+  static void parse_state_reserve(parse_state *s, VEC_LEN_T len, VEC_LEN_T cap, VEC_LEN_T amt) {
+    if (HEDLEY_UNLIKELY(len + amt > cap && s->arena != NULL)) {
+      parse_state_leave_arena(s);
+    }
   }
 
-  static span span_from_token(token t) {
-    span res= {
-      .start = t.start,
-      .len = t.len,
-    };
-    return res;
-  }
+  // Use these, rather than VEC_PUSH and VEC_APPEND, for the state's arrays
+  #define STATE_PUSH(s, vec, el)                                               \
+    {                                                                          \
+      parse_state_reserve((s), (vec)->len, (vec)->cap, 1);                     \
+      VEC_PUSH(vec, el);                                                       \
+    }
 
-  static span span_from_tokens(token start, token end) {
-    span res = {
-      .start = start.start,
-      .len = after_token_end(end) - start.start,
-    };
-    return res;
-  }
+  #define STATE_APPEND(s, vec, amt, els)                                       \
+    {                                                                          \
+      parse_state_reserve((s), (vec)->len, (vec)->cap, (amt));                 \
+      VEC_APPEND(vec, amt, els);                                               \
+    }
 
-  static span span_from_token_inds(token *tokens, node_ind_t a, node_ind_t b) {
-    return span_from_tokens(tokens[a], tokens[b]);
+  static pending_node tuple_node(parse_state*, parse_node_type_all, stack_ref_t);
+  static node_ind_t subs_depth(const parse_state *s, node_ind_t amt, const node_ind_t *subs);
+  static node_ind_t push_node(parse_state *s, pending_node node);
+  static node_ind_t push_node_at_depth(parse_state *s, pending_node node, node_ind_t depth);
+  static node_ind_t reserve_node(parse_state *s, node_ind_t first_token);
+  static void write_node(parse_state *s, node_ind_t ind, pending_node node);
+  static node_ind_t fill_form(parse_state *s, opened_form form, pending_node node);
+
+  static void set_tag(parse_state *s, node_ind_t ind, parse_node_type_all tag) {
+    VEC_DATA_PTR(&s->tags)[ind] = tag;
   }
 
-  static span span_from_nodes(parse_node start, parse_node end) {
+  // The end of input comes after the last token, and has no position
+  static span token_span(const parse_state *s, buf_ind_t ind) {
     span res = {
-      .start = start.phase_data.span.start,
-      .len = end.phase_data.span.start - start.phase_data.span.start + end.phase_data.span.len,
+      .start = ind < s->tokens.amt ? s->tokens.starts[ind] : 0,
+      .len = ind < s->tokens.amt ? s->tokens.lens[ind] : 0,
     };
     return res;
   }
 
-  static span span_from_node_inds(parse_node *nodes, node_ind_t start_ind, node_ind_t end_ind) {
-    return span_from_nodes(nodes[start_ind], nodes[end_ind]);
+  // When we're scanning as we go, only the last two tokens' symbols are kept.
+  // A name is reduced once the token after it comes in, and before that one
+  // is shifted, so that's enough.
+  static symbol_id token_symbol(const parse_state *s, buf_ind_t ind) {
+    return s->tokens.symbols != NULL ? s->tokens.symbols[ind]
+                                     : s->recent_symbols[ind % 2];
+  }
+
+  static node_ind_t node_first_token(const parse_state *s, node_ind_t ind) {
+    return VEC_DATA_PTR(&s->phase_data)[ind].first_token;
   }
 }
 
@@ -138,11 +224,12 @@
 root(RES) ::= toplevels(A) EOF . {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_APPEND(&s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
+  STATE_APPEND(s, &s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
   VEC_POP_N(&s->ind_stack, A);
   s->root_subs_start = start,
   s->root_subs_amt = A,
-  RES = s->nodes.len - 1;
+  s->max_depth = subs_depth(s, A, &VEC_DATA_PTR(&s->inds)[start]);
+  RES = s->tags.len - 1;
 }
 
 toplevels(RES) ::= . {
@@ -152,19 +239,19 @@ toplevels(RES) ::= . {
 
 toplevels(RES) ::= toplevels(A) toplevel(B) . {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 block(RES) ::= statement(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 block(RES) ::= block(A) statement(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
@@ -176,11 +263,9 @@ statement(RES) ::= expression(A). {
   RES = A;
 }
 
-statement(RES) ::= OPEN_PAREN(O) statement_in_parens(A) CLOSE_PAREN(C). {
+statement(RES) ::= open_paren(O) statement_in_parens(A) CLOSE_PAREN. {
   BREAK_PARSER;
-  // TODO take actual parse_node, instead of ind
-  VEC_DATA_PTR(&s->nodes)[A].phase_data.span = span_from_token_inds(s->tokens, O, C);
-  RES = A;
+  RES = fill_form(s, O, A);
 }
 
 statement_in_parens(RES) ::= let(A). {
@@ -192,9 +277,9 @@ statement_in_parens(RES) ::= sig(A). {
 }
 
 c_abi_annotation(RES) ::= HASH_ABI_C(A). {
-  parse_node n = {
+  pending_node n = {
     .type.statement = PT_STATEMENT_ABI_C,
-    .phase_data.span = span_from_token(s->tokens[A]),
+    .first_token = A,
   };
   RES = push_node(s, n);
 }
@@ -202,22 +287,20 @@ c_abi_annotation(RES) ::= HASH_ABI_C(A). {
 // TODO make this a pattern, not a binding
 let(RES) ::= LET lower_name_node(A) expression(B). {
   BREAK_PARSER;
-  A.type.all = PT_ALL_MULTI_TERM_NAME;
-  parse_node n = {
+  set_tag(s, A, PT_ALL_MULTI_TERM_NAME);
+  pending_node n = {
     .type.statement = PT_STATEMENT_LET,
     .data.two_subs = {
-      .a = push_node(s, A),
+      .a = A,
       .b = B,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
-toplevel(RES) ::= OPEN_PAREN(O) toplevel_under(A) CLOSE_PAREN(C). {
+toplevel(RES) ::= open_paren(O) toplevel_under(A) CLOSE_PAREN. {
   BREAK_PARSER;
-  // TODO redo to take a node
-  VEC_DATA_PTR(&s->nodes)[A].phase_data.span = span_from_token_inds(s->tokens, O, C);
-  RES = A;
+  RES = fill_form(s, O, A);
 }
 
 toplevel(RES) ::= c_abi_annotation(A). {
@@ -236,6 +319,21 @@ toplevel_under(RES) ::= datatype_decl(A). {
   RES = A;
 }
 
+// Reserves the node of the form this opens
+open_paren(RES) ::= OPEN_PAREN(A). {
+  opened_form form = {
+    .ind = reserve_node(s, A),
+  };
+  RES = form;
+}
+
+open_bracket(RES) ::= OPEN_BRACKET(A). {
+  opened_form form = {
+    .ind = reserve_node(s, A),
+  };
+  RES = form;
+}
+
 datatype_decl(RES) ::=
   DATA
   upper_name_node(N)
@@ -244,44 +342,40 @@ datatype_decl(RES) ::=
   BREAK_PARSER;
 
   node_ind_t start = s->inds.len;
-  N.type.all = PT_ALL_MULTI_TYPE_CONSTRUCTOR_NAME;
-  VEC_PUSH(&s->inds, push_node(s, N));
-  VEC_PUSH(&s->inds, A);
-  VEC_PUSH(&s->inds, B);
-  parse_node n = {
+  set_tag(s, N, PT_ALL_MULTI_TYPE_CONSTRUCTOR_NAME);
+  STATE_PUSH(s, &s->inds, N);
+  STATE_PUSH(s, &s->inds, A);
+  STATE_PUSH(s, &s->inds, B);
+  pending_node n = {
     .type.statement = PT_STATEMENT_DATA_DECLARATION,
     .data.more_subs = {
       .start = start,
       .amt = 3,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 data_constructor_decl(RES) ::=
-  OPEN_PAREN(OO)
-  // this is assumed to be below P on the ind_stack
-  // if that turns out to be false, I can return a node
-  // from upper_name
+  open_paren(O)
   upper_name_node(A)
   data_constructor_params(PS)
-  CLOSE_PAREN(CO). {
+  CLOSE_PAREN. {
   BREAK_PARSER;
 
   node_ind_t subs_start = s->inds.len;
-  A.type.all = PT_ALL_MULTI_DATA_CONSTRUCTOR_NAME;
-  VEC_PUSH(&s->inds, push_node(s, A));
-  VEC_APPEND(&s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
-  parse_node n = {
+  set_tag(s, A, PT_ALL_MULTI_DATA_CONSTRUCTOR_NAME);
+  STATE_PUSH(s, &s->inds, A);
+  STATE_APPEND(s, &s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
+  pending_node n = {
     .type.all = PT_ALL_MULTI_DATA_CONSTRUCTOR_DECL,
-    .phase_data.span = span_from_token_inds(s->tokens, OO, CO),
     .data.more_subs = {
       .start = subs_start,
       .amt = PS + 1,
     },
   };
   VEC_POP_N(&s->ind_stack, PS);
-  RES = push_node(s, n);
+  RES = fill_form(s, O, n);
 }
 
 data_constructor_params(RES) ::= . {
@@ -289,59 +383,65 @@ data_constructor_params(RES) ::= . {
 }
 
 data_constructor_params(RES) ::= data_constructor_params(A) type(B). {
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 data_constructor_decls_internal(RES) ::= data_constructor_decl(A). {
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 data_constructor_decls_internal(RES) ::= data_constructor_decls_internal(A) data_constructor_decl(B). {
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
-data_constructor_decls(RES) ::= data_constructor_decls_internal(A). {
+// Has no bracket of its own, so it reserves its node before its first
+// constructor, which starts at the lookahead
+data_constructors_start(RES) ::= . {
+  RES = reserve_node(s, s->pos);
+}
+
+data_constructor_decls(RES) ::= data_constructors_start(R) data_constructor_decls_internal(A). {
   node_ind_t subs_start = s->inds.len;
-  VEC_APPEND(&s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
-  parse_node n = {
+  STATE_APPEND(s, &s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
+  pending_node n = {
     .type.all = PT_ALL_MULTI_DATA_CONSTRUCTORS,
-    .phase_data.span = span_from_node_inds(VEC_DATA_PTR(&s->nodes), VEC_GET(s->ind_stack, s->ind_stack.len - A), VEC_LAST(s->ind_stack)),
     .data.more_subs = {
       .start = subs_start,
       .amt = A,
     },
   };
   VEC_POP_N(&s->ind_stack, A);
-  RES = push_node(s, n);
+  write_node(s, R, n);
+  RES = R;
 }
 
 type_param_decls(RES) ::= UNIT(A). {
-  parse_node n = {
+  pending_node n = {
     .type.all = PT_ALL_MULTI_TYPE_PARAMS,
-    .phase_data.span = span_from_token(s->tokens[A]),
+    .first_token = A,
     .data.more_subs = {
-      .start = 0,
+      .start = s->inds.len,
       .amt = 0,
     },
   };
   RES = push_node(s, n);
 }
 
-type_param_decls(RES) ::= OPEN_BRACKET(O) type_params(P) CLOSE_BRACKET(C). {
+type_param_decls(RES) ::= open_bracket(O) type_params(P) CLOSE_BRACKET. {
   node_ind_t subs_start = s->inds.len;
-  VEC_APPEND(&s->inds, P, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - P]);
-  parse_node n = {
+  STATE_APPEND(s, &s->inds, P, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - P]);
+  VEC_POP_N(&s->ind_stack, P);
+  pending_node n = {
     .type.all = PT_ALL_MULTI_TYPE_PARAMS,
-    .phase_data.span = span_from_token_inds(s->tokens, O, C),
     .data.more_subs = {
       .amt = P,
       .start = subs_start,
     },
   };
-  RES = push_node(s, n);
+  RES = fill_form(s, O, n);
 }
 
 type_params(RES) ::= . {
@@ -349,28 +449,28 @@ type_params(RES) ::= . {
 }
 
 type_params(RES) ::= type_params(A) lower_name_node(L). {
-  L.type.all = PT_ALL_MULTI_TYPE_PARAM_NAME;
-  VEC_PUSH(&s->ind_stack, L);
+  set_tag(s, L, PT_ALL_MULTI_TYPE_PARAM_NAME);
+  STATE_PUSH(s, &s->ind_stack, L);
   RES = A + 1;
 }
 
 // Don't use directly. Wrap.
 int(RES) ::= INT(A).  { 
   BREAK_PARSER;
-  parse_node n = {
-    .phase_data.span = span_from_token(s->tokens[A]),
+  pending_node n = {
+    .first_token = A,
   };
   RES = n;
 }
 
 expression(RES) ::= lower_name_node(A). {
-  A.type.expression = PT_EX_LOWER_VAR;
-  RES = push_node(s, A);
+  set_tag(s, A, PT_ALL_EX_TERM_NAME);
+  RES = A;
 }
 
 expression(RES) ::= upper_name_node(A). {
-  A.type.expression = PT_EX_UPPER_NAME;
-  RES = push_node(s, A);
+  set_tag(s, A, PT_ALL_EX_UPPER_NAME);
+  RES = A;
 }
 
 expression(RES) ::= unit(A). {
@@ -391,39 +491,44 @@ expression(RES) ::= int(A). {
 // Don't use directly. Wrap.
 string(RES) ::= STRING(A). {
   BREAK_PARSER;
-  parse_node n = {
-    .phase_data.span = span_from_token(s->tokens[A]),
+  pending_node n = {
+    .first_token = A,
   };
   RES = n;
 }
 
+// Names get pushed straight away, so that they come before the rest of their
+// form. The wrapping rule sets their type.
 upper_name_node(RES) ::= UPPER_NAME(A). {
   BREAK_PARSER;
-  parse_node n = {
-    .phase_data.span = span_from_token(s->tokens[A]),
+  pending_node n = {
+    .first_token = A,
+    .data.var_data.symbol = token_symbol(s, A),
   };
-  RES = n;
+  // a leaf, whatever it gets tagged as
+  RES = push_node_at_depth(s, n, 1);
 }
 
 lower_name_node(RES) ::= LOWER_NAME(A). {
   BREAK_PARSER;
-  parse_node n = {
-    .phase_data.span = span_from_token(s->tokens[A]),
+  pending_node n = {
+    .first_token = A,
+    .data.var_data.symbol = token_symbol(s, A),
   };
-  RES = n;
+  // a leaf, whatever it gets tagged as
+  RES = push_node_at_depth(s, n, 1);
 }
 
-expression(RES) ::= OPEN_BRACKET(A) expression_list_contents(B) CLOSE_BRACKET(C). {
+expression(RES) ::= open_bracket(A) expression_list_contents(B) CLOSE_BRACKET. {
   BREAK_PARSER;
-  VEC_DATA_PTR(&s->nodes)[B].phase_data.span = span_from_token_inds(s->tokens, A, C);
-  RES = B;
+  RES = fill_form(s, A, B);
 }
 
 expression_list_contents(RES) ::= commaexressions(A). {
   BREAK_PARSER;
   node_ind_t subs_start = s->inds.len;
-  VEC_APPEND(&s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
-  parse_node n = {
+  STATE_APPEND(s, &s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
+  pending_node n = {
     .type.expression = PT_EX_LIST,
     .data.more_subs = {
       .start = subs_start,
@@ -431,26 +536,24 @@ expression_list_contents(RES) ::= commaexressions(A). {
     },
   };
   VEC_POP_N(&s->ind_stack, A);
-  RES = push_node(s, n);
+  RES = n;
 }
 
 expression_list_contents(RES) ::= . {
   BREAK_PARSER;
-  parse_node n = {
+  pending_node n = {
     .type.expression = PT_EX_LIST,
     .data.more_subs = {
-      .start = 0,
+      .start = s->inds.len,
       .amt = 0,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
-expression(RES) ::= OPEN_PAREN(A) compound_expression(B) CLOSE_PAREN(C). {
+expression(RES) ::= open_paren(A) compound_expression(B) CLOSE_PAREN. {
   BREAK_PARSER;
-  parse_node *node = VEC_GET_PTR(s->nodes, B);
-  node->phase_data.span = span_from_token_inds(s->tokens, A, C);
-  RES = B;
+  RES = fill_form(s, A, B);
 }
 
 compound_expression(RES) ::= if(A). {
@@ -482,9 +585,9 @@ compound_expression(RES) ::= fn(A). {
 fn(RES) ::= FN param_decls(PS) fun_body(C). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_APPEND(&s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
-  VEC_PUSH(&s->inds, C);
-  parse_node n = {
+  STATE_APPEND(s, &s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
+  STATE_PUSH(s, &s->inds, C);
+  pending_node n = {
     .type.expression = PT_EX_FN,
     .data.more_subs = {
       .start = start,
@@ -492,23 +595,23 @@ fn(RES) ::= FN param_decls(PS) fun_body(C). {
     },
   };
   VEC_POP_N(&s->ind_stack, PS);
-  RES = push_node(s, n);
+  RES = n;
 }
 
 sig(RES) ::= SIG type(B). {
   BREAK_PARSER;
-  parse_node n = {
+  pending_node n = {
     .type.statement = PT_STATEMENT_SIG,
     .data.one_sub = {
       .ind = B,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 param_decls_internal(RES) ::= param_decls_internal(PS) pattern(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = PS + 1;
 }
 
@@ -517,6 +620,7 @@ param_decls_internal(RES) ::= . {
   RES = 0;
 }
 
+// The parameters don't get a node, so these parens don't reserve one
 param_decls(RES) ::= OPEN_PAREN param_decls_internal(A) CLOSE_PAREN. {
   BREAK_PARSER;
   RES = A;
@@ -530,11 +634,11 @@ param_decls(RES) ::= unit. {
 fun(RES) ::= FUN lower_name_node(A) param_decls(PS) fun_body(C). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  A.type.all = PT_ALL_MULTI_TERM_NAME;
-  VEC_PUSH(&s->inds, push_node(s, A));
-  VEC_APPEND(&s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
-  VEC_PUSH(&s->inds, C);
-  parse_node n = {
+  set_tag(s, A, PT_ALL_MULTI_TERM_NAME);
+  STATE_PUSH(s, &s->inds, A);
+  STATE_APPEND(s, &s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
+  STATE_PUSH(s, &s->inds, C);
+  pending_node n = {
     .type.statement = PT_STATEMENT_FUN,
     .data.more_subs = {
       .start = start,
@@ -542,35 +646,40 @@ fun(RES) ::= FUN lower_name_node(A) param_decls(PS) fun_body(C). {
     },
   };
   VEC_POP_N(&s->ind_stack, PS);
-  RES = push_node(s, n);
+  RES = n;
+}
+
+// Like data_constructors_start
+fun_body_start(RES) ::= . {
+  RES = reserve_node(s, s->pos);
 }
 
-fun_body(RES) ::= block(A). {
+fun_body(RES) ::= fun_body_start(R) block(A). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_APPEND(&s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
-  parse_node n = {
+  STATE_APPEND(s, &s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
+  pending_node n = {
     .type.expression = PT_EX_FUN_BODY,
-    .phase_data.span = span_from_node_inds(VEC_DATA_PTR(&s->nodes), VEC_GET(s->ind_stack, s->ind_stack.len - A), VEC_LAST(s->ind_stack)),
     .data.more_subs = {
       .start = start,
       .amt = A,
     },
   };
   VEC_POP_N(&s->ind_stack, A);
-  RES = push_node(s, n);
+  write_node(s, R, n);
+  RES = R;
 }
 
 pattern_tuple_min(RES) ::= pattern(A) COMMA pattern(B). {
   BREAK_PARSER;
   node_ind_t inds[2] = {A, B};
-  VEC_APPEND_STATIC(&s->ind_stack, inds);
+  STATE_APPEND(s, &s->ind_stack, STATIC_LEN(inds), inds);
   RES = 2;
 }
 
 pattern_tuple(RES) ::= pattern_tuple(A) COMMA pattern(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
@@ -585,13 +694,13 @@ pattern_list(RES) ::= . {
 
 pattern_list_rec(RES) ::= pattern_list_rec(A) COMMA pattern(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 pattern_list_rec(RES) ::= pattern(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
@@ -601,20 +710,20 @@ pattern_list(RES) ::= pattern_list_rec(A). {
 
 patterns(RES) ::= pattern(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 patterns(RES) ::= patterns(A) pattern(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 pattern(RES) ::= lower_name_node(A). {
   BREAK_PARSER;
-  A.type.pattern = PT_PAT_WILDCARD;
-  RES = push_node(s, A);
+  set_tag(s, A, PT_ALL_PAT_WILDCARD);
+  RES = A;
 }
 
 pattern(RES) ::= unit(A). {
@@ -637,9 +746,8 @@ pattern(RES) ::= string(A). {
 
 unit(RES) ::= UNIT(A). {
   BREAK_PARSER;
-  token t = s->tokens[A];
-  parse_node n = {
-    .phase_data.span = span_from_token(s->tokens[A]),
+  pending_node n = {
+    .first_token = A,
     .data.two_subs = {
       .a = 0,
       .b = 0,
@@ -648,11 +756,9 @@ unit(RES) ::= UNIT(A). {
   RES = n;
 }
 
-pattern(RES) ::= OPEN_PAREN(O) pattern_in_parens(A) CLOSE_PAREN(C). {
+pattern(RES) ::= open_paren(O) pattern_in_parens(A) CLOSE_PAREN. {
   BREAK_PARSER;
-  parse_node *node = VEC_GET_PTR(s->nodes, A);
-  node->phase_data.span = span_from_token_inds(s->tokens, O, C);
-  RES = A;
+  RES = fill_form(s, O, A);
 }
 
 pattern_in_parens(RES) ::= pattern_construction(A). {
@@ -661,61 +767,61 @@ pattern_in_parens(RES) ::= pattern_construction(A). {
 
 pattern_in_parens(RES) ::= pattern_tuple(A). {
   BREAK_PARSER;
-  RES = desugar_tuple(s, PT_ALL_PAT_TUP, A);
+  RES = tuple_node(s, PT_ALL_PAT_TUP, A);
 }
 
 pattern_construction(RES) ::= upper_name_node(A) patterns(B). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  A.type.pattern = PT_PAT_DATA_CONSTRUCTOR_NAME;
-  VEC_PUSH(&s->inds, push_node(s, A));
-  VEC_APPEND(&s->inds, B, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - B]);
+  set_tag(s, A, PT_ALL_PAT_DATA_CONSTRUCTOR_NAME);
+  STATE_PUSH(s, &s->inds, A);
+  STATE_APPEND(s, &s->inds, B, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - B]);
   VEC_POP_N(&s->ind_stack, B);
-  parse_node n = {
+  pending_node n = {
     .type.pattern = PT_PAT_CONSTRUCTION,
     .data.more_subs = {
       .start = start,
       .amt = B + 1,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
-pattern(RES) ::= OPEN_BRACKET(O) pattern_list(A) CLOSE_BRACKET(C). {
+pattern(RES) ::= open_bracket(O) pattern_list(A) CLOSE_BRACKET. {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_APPEND(&s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
+  STATE_APPEND(s, &s->inds, A, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - A]);
   VEC_POP_N(&s->ind_stack, A);
-  parse_node n = {
+  pending_node n = {
     .type.pattern = PT_PAT_LIST,
-    .phase_data.span = span_from_token_inds(s->tokens, O, C),
     .data.more_subs = {
       .start = start,
       .amt = A,
     },
   };
-  RES = push_node(s, n);
+  RES = fill_form(s, O, n);
 }
 
 type(RES) ::= upper_name_node(A). {
-  A.type.type = PT_TY_CONSTRUCTOR_NAME;
-  RES = push_node(s, A);
+  set_tag(s, A, PT_ALL_TY_CONSTRUCTOR_NAME);
+  RES = A;
 }
 
-type(RES) ::= OPEN_BRACKET(O) type_inside_brackets(B) CLOSE_BRACKET(C). {
+type(RES) ::= open_bracket(O) type_inside_brackets(B) CLOSE_BRACKET. {
   BREAK_PARSER;
-  parse_node n = {
+  pending_node n = {
     .type.type = PT_TY_LIST,
-    .phase_data.span = span_from_token_inds(s->tokens, O, C),
     .data.one_sub = {
       .ind = B,
     },
   };
-  RES = push_node(s, n);
+  RES = fill_form(s, O, n);
 }
 
+// No bracket of its own to reserve a node, so this one ends up after its
+// children
 type_inside_brackets(RES) ::= type_inside_parens(A). {
-  RES = A;
+  RES = push_node(s, A);
 }
 
 type_inside_brackets(RES) ::= type(A). {
@@ -728,10 +834,9 @@ type(RES) ::= unit(A). {
   RES = push_node(s, A);
 }
 
-type(RES) ::= OPEN_PAREN(A) type_inside_parens_or_tuple(B) CLOSE_PAREN(D). {
+type(RES) ::= open_paren(A) type_inside_parens_or_tuple(B) CLOSE_PAREN. {
   BREAK_PARSER;
-  VEC_GET_PTR(s->nodes, B)->phase_data.span = span_from_token_inds(s->tokens, A, D);
-  RES = B;
+  RES = fill_form(s, A, B);
 }
 
 type_inside_parens(RES) ::= fn_type(A). {
@@ -740,7 +845,7 @@ type_inside_parens(RES) ::= fn_type(A). {
 
 type_inside_parens_or_tuple(RES) ::= type_inner_tuple(A). {
   BREAK_PARSER;
-  RES = desugar_tuple(s, PT_ALL_TY_TUP, A);
+  RES = tuple_node(s, PT_ALL_TY_TUP, A);
 }
 
 type_inside_parens_or_tuple(RES) ::= type_inside_parens(A). {
@@ -750,86 +855,88 @@ type_inside_parens_or_tuple(RES) ::= type_inside_parens(A). {
 // TODO multi param types
 type_inside_parens(RES) ::= type(A) type(B). {
   BREAK_PARSER;
-  parse_node n = {
+  pending_node n = {
     .type.type = PT_TY_CONSTRUCTION,
+    .first_token = node_first_token(s, A),
     .data.two_subs = {
       .a = A,
       .b = B,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 // At minimum we need a return type
 fn_type_params(RES) ::= type(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 fn_type_params(RES) ::= fn_type_params(PS) type(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = PS + 1;
 }
 
 // TODO Add this as a builtin type constructor, and use normal call resolution?
-fn_type(RES) ::= FN_TYPE fn_type_params(PS). {
+fn_type(RES) ::= FN_TYPE(F) fn_type_params(PS). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_APPEND(&s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
+  STATE_APPEND(s, &s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
   VEC_POP_N(&s->ind_stack, PS);
-  parse_node n = {
+  pending_node n = {
     .type.type = PT_TY_FN,
+    .first_token = F,
     .data.more_subs = {
       .start = start,
       .amt = PS,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 type_inner_tuple(RES) ::= type(A) COMMA type(B). {
   BREAK_PARSER;
   node_ind_t inds[] = {A, B};
-  VEC_APPEND_STATIC(&s->ind_stack, inds);
+  STATE_APPEND(s, &s->ind_stack, STATIC_LEN(inds), inds);
   RES = 2;
 }
 
 type_inner_tuple(RES) ::= type_inner_tuple(A) COMMA type(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 typed(RES) ::= AS type(A) expression(B). {
   BREAK_PARSER;
-  parse_node n = {
+  pending_node n = {
     .type.expression = PT_EX_AS,
     .data.two_subs = {
       .a = A,
       .b = B,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 tuple(RES) ::= tuple_rec(A) COMMA expression(B). {
   BREAK_PARSER;
   // start and end get set by compound_expression
-  VEC_PUSH(&s->ind_stack, B);
-  RES = desugar_tuple(s, PT_ALL_EX_TUP, A + 1);
+  STATE_PUSH(s, &s->ind_stack, B);
+  RES = tuple_node(s, PT_ALL_EX_TUP, A + 1);
 }
 
 tuple_min(RES) ::= expression(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 tuple_rec(RES) ::= tuple_rec(A) COMMA expression(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
@@ -843,7 +950,7 @@ expressions(RES) ::= . {
 
 expressions(RES) ::= call_params(N) expression(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = N + 1;
 }
 
@@ -854,45 +961,45 @@ call_params(RES) ::= expressions(A). {
 call(RES) ::= expression(A) call_params(PS). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_PUSH(&s->inds, A);
-  VEC_APPEND(&s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
+  STATE_PUSH(s, &s->inds, A);
+  STATE_APPEND(s, &s->inds, PS, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - PS]);
   VEC_POP_N(&s->ind_stack, PS);
-  parse_node n = {
+  pending_node n = {
     .type.expression = PT_EX_CALL,
     .data.more_subs = {
       .start = start,
       .amt = PS + 1,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 commaexressions(RES) ::= expression(A). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, A);
+  STATE_PUSH(s, &s->ind_stack, A);
   RES = 1;
 }
 
 commaexressions(RES) ::= commaexressions(A) COMMA expression(B). {
   BREAK_PARSER;
-  VEC_PUSH(&s->ind_stack, B);
+  STATE_PUSH(s, &s->ind_stack, B);
   RES = A + 1;
 }
 
 if(RES) ::= IF expression(A) expression(B) expression(C). {
   BREAK_PARSER;
   node_ind_t start = s->inds.len;
-  VEC_PUSH(&s->inds, A);
-  VEC_PUSH(&s->inds, B);
-  VEC_PUSH(&s->inds, C);
-  parse_node n = {
+  STATE_PUSH(s, &s->inds, A);
+  STATE_PUSH(s, &s->inds, B);
+  STATE_PUSH(s, &s->inds, C);
+  pending_node n = {
     .type.expression = PT_EX_IF,
     .data.more_subs = {
       .start = start,
       .amt = 3,
     },
   };
-  RES = push_node(s, n);
+  RES = n;
 }
 
 %syntax_error {
@@ -900,6 +1007,9 @@ if(RES) ::= IF expression(A) expression(B) expression(C). {
   vec_token_type expected = VEC_NEW;
   if (s->success) {
     s->error_pos = s->pos;
+    s->error_span = token_span(s, TOKEN);
+    // Read straight off the state we failed in, so reporting errors doesn't
+    // need a second parse
     for (token_type i = 0; i < YYNTOKEN; i++) {
       int a = yy_find_shift_action((YYCODETYPE)i, yypParser->yytos->stateno);
       if (a != YY_ERROR_ACTION) VEC_PUSH(&expected, i);
@@ -916,116 +1026,655 @@ if(RES) ::= IF expression(A) expression(B) expression(C). {
 }
 
 %code {
-  static node_ind_t push_node(parse_state *s, parse_node node) {
-    VEC_PUSH(&s->nodes, node);
-    return s->nodes.len - 1;
+  // A walk has the later siblings waiting while it's under an earlier one
+  static node_ind_t subs_depth(const parse_state *s, node_ind_t amt, const node_ind_t *subs) {
+    const node_ind_t *depths = VEC_DATA_PTR(&s->depths);
+    node_ind_t res = 0;
+    for (node_ind_t i = 0; i < amt; i++) {
+      res = MAX(res, amt - 1 - i + depths[subs[i]]);
+    }
+    return res;
   }
 
-  static node_ind_t desugar_tuple(parse_state *s, parse_node_type_all tag, stack_ref_t el_amount) {
-    vec_node_ind ind_stack = s->ind_stack;
-    node_ind_t node_amt = s->nodes.len;
-
-    // The generated tuples will have their end set to the end
-    // of the last syntactic element. Best we can do.
-    parse_node last_inner_node = VEC_GET(s->nodes, VEC_PEEK(ind_stack));
-    buf_ind_t after_inner_end = last_inner_node.phase_data.span.start + last_inner_node.phase_data.span.len;
-
-    for (node_ind_t i = 0; i < el_amount - 2; i++) {
-      node_ind_t sub_a_ind = VEC_GET(ind_stack, ind_stack.len - el_amount + i);
-      buf_ind_t current_node_start = VEC_GET(s->nodes, sub_a_ind).phase_data.span.start;
-      parse_node n = {
-        .type.all = tag,
-        .data.two_subs = {
-          .a = sub_a_ind,
-          .b = node_amt + i + 1,
-        },
-        .phase_data.span = {
-          .start = current_node_start,
-          .len = after_inner_end - current_node_start,
-        },
-      };
-      VEC_PUSH(&s->nodes, n);
-    }
+  static node_ind_t pending_node_depth(const parse_state *s, pending_node node) {
+    node_ind_t amt;
+    const node_ind_t *subs = pt_node_subs(node.type.all, &node.data, VEC_DATA_PTR(&s->inds), &amt);
+    return 1 + subs_depth(s, amt, subs);
+  }
+
+  static node_ind_t push_node_at_depth(parse_state *s, pending_node node, node_ind_t depth) {
+    parse_node_phase_data phase_data = {.first_token = node.first_token};
+    u8 tag = node.type.all;
+    STATE_PUSH(s, &s->node_data, node.data);
+    STATE_PUSH(s, &s->phase_data, phase_data);
+    STATE_PUSH(s, &s->tags, tag);
+    STATE_PUSH(s, &s->depths, depth);
+    return s->tags.len - 1;
+  }
+
+  static node_ind_t push_node(parse_state *s, pending_node node) {
+    return push_node_at_depth(s, node, pending_node_depth(s, node));
+  }
+
+  static void write_node(parse_state *s, node_ind_t ind, pending_node node) {
+    VEC_DATA_PTR(&s->node_data)[ind] = node.data;
+    VEC_DATA_PTR(&s->depths)[ind] = pending_node_depth(s, node);
+    set_tag(s, ind, node.type.all);
+  }
 
-    node_ind_t sub_a_ind = VEC_GET(ind_stack, ind_stack.len - 2);
-    buf_ind_t first_node_buf_start = VEC_GET(s->nodes, sub_a_ind).phase_data.span.start;
-    parse_node last_node = {
+  // Takes the next slot, for a node whose children we haven't seen yet
+  static node_ind_t reserve_node(parse_state *s, node_ind_t first_token) {
+    pending_node n = {.first_token = first_token};
+    // write_node fills in the depth, too
+    return push_node_at_depth(s, n, 0);
+  }
+
+  static node_ind_t fill_form(parse_state *s, opened_form form, pending_node node) {
+    write_node(s, form.ind, node);
+    return form.ind;
+  }
+
+  // Moves a tuple's elements off the stack, for the caller to put in its
+  // reserved slot
+  static pending_node tuple_node(parse_state *s, parse_node_type_all tag, stack_ref_t el_amount) {
+    node_ind_t start = s->inds.len;
+    STATE_APPEND(s, &s->inds, el_amount, &VEC_DATA_PTR(&s->ind_stack)[s->ind_stack.len - el_amount]);
+    VEC_POP_N(&s->ind_stack, el_amount);
+    pending_node n = {
       .type.all = tag,
-      .data.two_subs = {
-        .a = sub_a_ind,
-        .b = VEC_LAST(ind_stack),
-      },
-      .phase_data.span = {
-        .start = first_node_buf_start,
-        .len = after_inner_end - first_node_buf_start,
+      .data.more_subs = {
+        .start = start,
+        .amt = el_amount,
       },
     };
-    VEC_PUSH(&s->nodes, last_node);
-
-    VEC_POP_N(&s->ind_stack, el_amount);
-    return node_amt;
+    return n;
   }
 
-  static parse_tree_res parse_internal(token *tokens, size_t token_amt, bool get_expected) {
-#ifdef TIME_PARSER
-    perf_state perf_state = perf_start();
-#endif
-    yyParser xp;
-    ParseInit(&xp);
+  static parse_state parse_state_new(void) {
     parse_state state = {
-      .tokens = tokens,
       .success = true,
       .root_subs_start = 0,
       .root_subs_amt = 0,
-      .nodes = VEC_NEW,
+      .node_data = VEC_NEW,
+      .phase_data = VEC_NEW,
+      .tags = VEC_NEW,
       .inds = VEC_NEW,
+      .ind_stack = VEC_NEW,
+      .depths = VEC_NEW,
+      .max_depth = 0,
+      .token_starts = VEC_NEW,
+      .token_lens = VEC_NEW,
       .pos = 0,
-      // TODO remove? I think this is something to do with error checking that isn't
-      // necessary anymore
-      .get_expected = get_expected,
+      .slice = false,
       .error_pos = -1,
       .expected_amt = 0,
       .expected = NULL,
+      .arena = NULL,
     };
+    return state;
+  }
 
-    for (; state.pos < token_amt; state.pos++) {
-      Parse(&xp, tokens[state.pos].type, state.pos, &state);
+  // Every node starts at a token of its own, apart from a few synthetic ones,
+  // and each of those stands in for a token that doesn't make a node (a
+  // keyword, or a closing bracket). So there are at most as many nodes as
+  // tokens. Every node is a child of at most one other node, so `inds` and
+  // `ind_stack` are bounded by the number of nodes, too. `depths` is only
+  // needed until the tree is finished, so it doesn't need to move. Nothing
+  // relies on these bounds, as the arrays leave the arena if they're wrong.
+  static parse_state parse_state_new_arena(size_t token_amt) {
+    VEC_LEN_T cap = MAX(token_amt, 1);
+    // Arrays are laid out in decreasing order of alignment
+    size_t data_bytes = sizeof(parse_node_data) * cap;
+    size_t phase_data_bytes = sizeof(parse_node_phase_data) * cap;
+    size_t inds_bytes = sizeof(node_ind_t) * cap;
+    size_t tags_bytes = sizeof(u8) * cap;
+    char *arena =
+      malloc(data_bytes + phase_data_bytes + inds_bytes * 3 + tags_bytes);
+    char *phase_data = arena + data_bytes;
+    char *inds = phase_data + phase_data_bytes;
+    char *ind_stack = inds + inds_bytes;
+    char *depths = ind_stack + inds_bytes;
+    char *tags = depths + inds_bytes;
+    parse_state state = parse_state_new();
+    state.arena = arena;
+    state.node_data = (vec_parse_node_data){
+      .len = 0,
+      .cap = cap,
+      .data = (parse_node_data *)arena,
+    };
+    state.phase_data = (vec_parse_node_phase_data){
+      .len = 0,
+      .cap = cap,
+      .data = (parse_node_phase_data *)phase_data,
+    };
+    state.inds = (vec_node_ind){
+      .len = 0,
+      .cap = cap,
+      .data = (node_ind_t *)inds,
+    };
+    state.ind_stack = (vec_node_ind){
+      .len = 0,
+      .cap = cap,
+      .data = (node_ind_t *)ind_stack,
+    };
+    state.depths = (vec_node_ind){
+      .len = 0,
+      .cap = cap,
+      .data = (node_ind_t *)depths,
+    };
+    state.tags = (vec_u8){
+      .len = 0,
+      .cap = cap,
+      .data = (u8 *)tags,
+    };
+    return state;
+  }
+
+  // Each array gets an allocation of its own, with the same capacity as in the
+  // arena, and finalizing takes the vec path from there on
+  static void parse_state_leave_arena(parse_state *s) {
+    char *arena = s->arena;
+    s->arena = NULL;
+  #define LEAVE_ARENA(vec)                                                     \
+    {                                                                          \
+      void *data = malloc(VEC_ELSIZE(vec) * (vec)->cap);                       \
+      memcpy(data, (vec)->data, VEC_ELSIZE(vec) * (vec)->len);                 \
+      (vec)->data = data;                                                      \
     }
-    Parse(&xp, 0, 0, &state);
-    ParseFinalize(&xp);
+    LEAVE_ARENA(&s->node_data);
+    LEAVE_ARENA(&s->phase_data);
+    LEAVE_ARENA(&s->inds);
+    LEAVE_ARENA(&s->ind_stack);
+    LEAVE_ARENA(&s->depths);
+    LEAVE_ARENA(&s->tags);
+  #undef LEAVE_ARENA
+    free(arena);
+  }
+
+  // The tree's arrays live in one allocation, which `node_data` owns. They're
+  // packed in the same order as in the arena.
+  static void finalize_tree_arrays(parse_state *state, parse_tree *tree) {
+    node_ind_t node_amt = state->tags.len;
+    size_t data_bytes = sizeof(parse_node_data) * node_amt;
+    size_t phase_data_bytes = sizeof(parse_node_phase_data) * node_amt;
+    size_t inds_bytes = sizeof(node_ind_t) * state->inds.len;
+    size_t tags_bytes = sizeof(u8) * node_amt;
+    size_t phase_data_offset = data_bytes;
+    size_t inds_offset = phase_data_offset + phase_data_bytes;
+    size_t tags_offset = inds_offset + inds_bytes;
+    size_t total_bytes = tags_offset + tags_bytes;
+    char *buf;
+    if (state->arena != NULL) {
+      // parse_state_reserve would have moved us out of the arena if we'd
+      // outgrown it
+      debug_assert(VEC_DATA_PTR(&state->node_data) ==
+                   (parse_node_data *)state->arena);
+      // Every array moves down, and in order, so we never overwrite one we
+      // haven't moved yet
+      buf = state->arena;
+      memmove(buf + phase_data_offset,
+              VEC_DATA_PTR(&state->phase_data),
+              phase_data_bytes);
+      memmove(buf + inds_offset, VEC_DATA_PTR(&state->inds), inds_bytes);
+      memmove(buf + tags_offset, VEC_DATA_PTR(&state->tags), tags_bytes);
+      // Hand back the tail. For big trees, this is an mremap.
+      buf = realloc(buf, MAX(total_bytes, 1));
+    } else {
+      buf = realloc(VEC_DATA_PTR(&state->node_data), MAX(total_bytes, 1));
+      memcpy(buf + phase_data_offset,
+             VEC_DATA_PTR(&state->phase_data),
+             phase_data_bytes);
+      memcpy(buf + inds_offset, VEC_DATA_PTR(&state->inds), inds_bytes);
+      memcpy(buf + tags_offset, VEC_DATA_PTR(&state->tags), tags_bytes);
+      VEC_FREE(&state->phase_data);
+      VEC_FREE(&state->inds);
+      VEC_FREE(&state->tags);
+    }
+    tree->node_data = (parse_node_data *)buf;
+    tree->phase_data = (parse_node_phase_data *)(buf + phase_data_offset);
+    tree->inds = (node_ind_t *)(buf + inds_offset);
+    tree->tags = (u8 *)(buf + tags_offset);
+  }
+
+  // The tree keeps its own copy of where the tokens are, so that spans can be
+  // rebuilt after the tokens are gone
+  static void retain_token_positions(parse_tree *tree, const buf_ind_t *starts, const token_len_t *lens, size_t token_amt) {
+    size_t starts_bytes = sizeof(buf_ind_t) * token_amt;
+    size_t lens_bytes = sizeof(token_len_t) * token_amt;
+    tree->token_starts = malloc(MAX(starts_bytes, 1));
+    tree->token_lens = malloc(MAX(lens_bytes, 1));
+    memcpy(tree->token_starts, starts, starts_bytes);
+    memcpy(tree->token_lens, lens, lens_bytes);
+    tree->token_amt = token_amt;
+  }
 
+  static parse_tree_res parse_state_finalize(parse_state *state) {
     parse_tree_res res =  {
-      .success = state.success,
+      .success = state->success,
       .tree = {
-        .node_amt = state.nodes.len,
-        .ind_amt = state.inds.len,
-        .root_subs_start = state.root_subs_start,
-        .root_subs_amt = state.root_subs_amt,
+        .node_amt = state->tags.len,
+        .ind_amt = state->inds.len,
+        .root_subs_start = state->root_subs_start,
+        .root_subs_amt = state->root_subs_amt,
+        .max_depth = state->max_depth,
       },
       .errors = {
-        .error_pos = state.error_pos,
-        .expected_amt = state.expected_amt,
-        .expected = state.expected,
+        .error_pos = state->error_pos,
+        .error_span = state->error_span,
+        .expected_amt = state->expected_amt,
+        .expected = state->expected,
       },
     };
     if (res.success) {
-      res.tree.nodes = VEC_FINALIZE(&state.nodes);
-      res.tree.inds = VEC_FINALIZE(&state.inds);
-      assert(state.ind_stack.len == 0);
-      res.tree = reorder_tree(res.tree);
+      assert(state->ind_stack.len == 0);
+      finalize_tree_arrays(state, &res.tree);
+    } else if (state->arena != NULL) {
+      free(state->arena);
     } else {
-      VEC_FREE(&state.nodes);
-      VEC_FREE(&state.inds);
+      VEC_FREE(&state->node_data);
+      VEC_FREE(&state->phase_data);
+      VEC_FREE(&state->tags);
+      VEC_FREE(&state->inds);
     }
     // we turn asserts into debug_asserts in this file
-    VEC_FREE(&state.ind_stack);
+    if (state->arena == NULL) {
+      VEC_FREE(&state->ind_stack);
+      VEC_FREE(&state->depths);
+    }
+    return res;
+  }
+
+  // After the last token, lemon expects a zero, and a slice expects an EOF
+  // first
+  static YYCODETYPE token_past_end(const parse_state *s, size_t token_amt) {
+    return s->slice && s->pos == token_amt ? TK_EOF : 0;
+  }
+
+  // One call to Parse() per token, which looks each action up in lemon's
+  // compressed tables
+  static void parse_tokens_lemon(yyParser *p, tokens_res tres, parse_state *s) {
+    for (; s->pos < tres.token_amt; s->pos++) {
+      Parse(p, tres.types[s->pos], s->pos, s);
+      // Nothing after the first parse error gets reported anyway
+      if (!s->success) {
+        return;
+      }
+    }
+    if (s->slice) {
+      Parse(p, TK_EOF, tres.token_amt, s);
+      if (!s->success) {
+        return;
+      }
+    }
+    Parse(p, 0, tres.token_amt, s);
+  }
+
+  // The table driver.
+  //
+  // lemon packs its action tables tightly, so every lookup is a few dependent
+  // loads and compares, and Parse() is an out-of-line call per token. Our
+  // grammar is small enough that a dense (state x terminal) table fits in L1,
+  // so we expand lemon's tables once, and run the whole token array through
+  // one loop. Each entry carries its action's kind, which we dispatch on
+  // directly.
+  //
+  // The stack is still lemon's, so both drivers build identical trees. It's
+  // sized from the token count up front, and shifts push onto it directly.
+  // Semantic actions and gotos still go through lemon's yy_reduce, as that's
+  // where lemon puts the actions, so reductions keep its check for room.
+  //
+  // Rows past YY_MAX_SHIFT are the states lemon leaves on the stack after a
+  // shift-reduce, which reduce no matter the lookahead.
+
+  #if YY_MAX_REDUCE >= (1 << 13)
+    #error "Parser actions don't fit in a table entry"
+  #endif
+
+  typedef uint16_t lr_entry;
+
+  enum {
+    LR_SHIFT,
+    LR_SHIFT_REDUCE,
+    LR_REDUCE,
+    LR_ACCEPT,
+    LR_ERROR,
+  };
+
+  #define LR_KIND_BITS 3
+  #define LR_KIND_MASK ((1 << LR_KIND_BITS) - 1)
+
+  static lr_entry lr_table[YY_MAX_REDUCE + 1][YYNTOKEN];
+  static pthread_once_t lr_table_once = PTHREAD_ONCE_INIT;
+
+  static lr_entry lr_entry_from_action(YYACTIONTYPE act) {
+    if (act <= YY_MAX_SHIFT) {
+      return act << LR_KIND_BITS | LR_SHIFT;
+    }
+    if (act <= YY_MAX_SHIFTREDUCE) {
+      return (act - YY_MIN_SHIFTREDUCE) << LR_KIND_BITS | LR_SHIFT_REDUCE;
+    }
+    if (act >= YY_MIN_REDUCE) {
+      return (act - YY_MIN_REDUCE) << LR_KIND_BITS | LR_REDUCE;
+    }
+    if (act == YY_ACCEPT_ACTION) {
+      return LR_ACCEPT;
+    }
+    return LR_ERROR;
+  }
+
+  static void build_lr_table(void) {
+    for (unsigned state = 0; state <= YY_MAX_REDUCE; state++) {
+      for (unsigned tok = 0; tok < YYNTOKEN; tok++) {
+        YYACTIONTYPE act;
+        if (state > YY_MAX_SHIFT) {
+          act = state;
+        } else if (state > YY_SHIFT_COUNT) {
+          // lemon trims states without terminal actions from its tables
+          act = yy_default[state];
+        } else {
+          act = yy_find_shift_action((YYCODETYPE)tok, (YYACTIONTYPE)state);
+        }
+        lr_table[state][tok] = lr_entry_from_action(act);
+      }
+    }
+  }
+
+  static void reserve_parser_stack(yyParser *p, size_t amt) {
+    while ((size_t)p->yystksz < amt && yyGrowStack(p) == 0) {}
+  }
+
+  // yy_shift, without the tracing, or the check for shift-reduce states,
+  // which we make ourselves. Every token is shifted at most once, so this
+  // only runs out of room when empty rules have pushed a lot of their own.
+  HEDLEY_INLINE
+  static bool lr_push(yyParser *p, YYACTIONTYPE state, YYCODETYPE tok, buf_ind_t minor) {
+    if (HEDLEY_UNLIKELY(p->yytos + 1 >= p->yystack + p->yystksz) && yyGrowStack(p)) {
+      yyStackOverflow(p);
+      return false;
+    }
+    yyStackEntry *top = ++p->yytos;
+    top->stateno = state;
+    top->major = tok;
+    top->minor.yy0 = minor;
+    return true;
+  }
+
+  // Labels as values are a GNU extension
+  #if defined(__GNUC__)
+    #define LR_COMPUTED_GOTO
+  #endif
+
+  static void parse_tokens_table(yyParser *p, tokens_res tres, parse_state *s) {
+    pthread_once(&lr_table_once, build_lr_table);
+    // One entry for the bottom of the stack, and one for each token, and the
+    // end of input. Pages past what we use are never touched.
+    reserve_parser_stack(p, (size_t)tres.token_amt + 2);
+    p->s = s;
+
+    YYACTIONTYPE state = p->yytos->stateno;
+    YYCODETYPE tok;
+    buf_ind_t minor;
+    lr_entry entry;
+    unsigned ruleno;
+
+  // Only the type array is read here
+  #define LR_LOAD_TOKEN()                                                  \
+    do {                                                                   \
+      minor = s->pos;                                                      \
+      if (HEDLEY_LIKELY(s->pos < tres.token_amt)) {                        \
+        tok = (YYCODETYPE)tres.types[s->pos];                              \
+      } else {                                                             \
+        tok = token_past_end(s, tres.token_amt);                           \
+      }                                                                    \
+    } while (0)
+
+  #ifdef LR_COMPUTED_GOTO
+    HEDLEY_DIAGNOSTIC_PUSH
+    #pragma GCC diagnostic ignored "-Wpedantic"
+    #if defined(__clang__)
+      #pragma clang diagnostic ignored "-Wgnu-label-as-value"
+    #endif
+    static const void *const lr_labels[] = {
+      [LR_SHIFT] = &&lr_shift,
+      [LR_SHIFT_REDUCE] = &&lr_shift_reduce,
+      [LR_REDUCE] = &&lr_reduce,
+      [LR_ACCEPT] = &&lr_accept,
+      [LR_ERROR] = &&lr_error,
+    };
+    #define LR_DISPATCH()                                                  \
+      do {                                                                 \
+        entry = lr_table[state][tok];                                      \
+        goto *lr_labels[entry & LR_KIND_MASK];                             \
+      } while (0)
+  #else
+    #define LR_DISPATCH()                                                  \
+      do {                                                                 \
+        entry = lr_table[state][tok];                                      \
+        goto lr_dispatch;                                                  \
+      } while (0)
+  #endif
+
+    LR_LOAD_TOKEN();
+    LR_DISPATCH();
+
+  #ifndef LR_COMPUTED_GOTO
+  lr_dispatch:
+    switch (entry & LR_KIND_MASK) {
+      case LR_SHIFT:
+        goto lr_shift;
+      case LR_SHIFT_REDUCE:
+        goto lr_shift_reduce;
+      case LR_REDUCE:
+        goto lr_reduce;
+      case LR_ACCEPT:
+        goto lr_accept;
+      default:
+        goto lr_error;
+    }
+  #endif
+
+  lr_shift:
+    state = entry >> LR_KIND_BITS;
+    if (HEDLEY_UNLIKELY(!lr_push(p, state, tok, minor))) {
+      goto lr_out_of_memory;
+    }
+    s->pos++;
+    LR_LOAD_TOKEN();
+    LR_DISPATCH();
+
+  lr_shift_reduce:
+    // We reduce straight away, rather than looking up the state lemon pushes,
+    // which would tell us to do the same
+    ruleno = entry >> LR_KIND_BITS;
+    // The state yy_shift would have pushed
+    if (HEDLEY_UNLIKELY(!lr_push(p, (YYACTIONTYPE)(ruleno + YY_MIN_REDUCE), tok, minor))) {
+      goto lr_out_of_memory;
+    }
+    s->pos++;
+    LR_LOAD_TOKEN();
+    goto lr_reduce_rule;
+
+  lr_reduce:
+    ruleno = entry >> LR_KIND_BITS;
+  lr_reduce_rule:
+    state = yy_reduce(p, ruleno, tok, minor);
+    LR_DISPATCH();
+
+  lr_accept:
+    p->yytos--;
+    yy_accept(p);
+    return;
+
+  lr_error:
+    // Nothing after the first error is reported, so unlike lemon's driver, we
+    // don't bother carrying on
+    yy_syntax_error(p, tok, minor);
+    return;
+
+  lr_out_of_memory:
+    s->success = false;
+    return;
+
+  #ifdef LR_COMPUTED_GOTO
+    HEDLEY_DIAGNOSTIC_POP
+  #endif
+  #undef LR_LOAD_TOKEN
+  #undef LR_DISPATCH
+  }
+
+  static parse_tree_res parse_internal(tokens_res tres, parser_driver driver, bool slice) {
+#ifdef TIME_PARSER
+    perf_state perf_state = perf_start();
+#endif
+    yyParser xp;
+    ParseInit(&xp);
+    parse_state state = parse_state_new_arena(tres.token_amt);
+    state.slice = slice;
+    state.tokens = (token_arrays){
+      .starts = tres.starts,
+      .lens = tres.lens,
+      .symbols = tres.symbols,
+      .amt = tres.token_amt,
+    };
+
+    switch (driver) {
+      case PARSER_DRIVER_LEMON:
+        parse_tokens_lemon(&xp, tres, &state);
+        break;
+      case PARSER_DRIVER_TABLE:
+        parse_tokens_table(&xp, tres, &state);
+        break;
+    }
+    ParseFinalize(&xp);
+
+    parse_tree_res res = parse_state_finalize(&state);
+    if (res.success) {
+      retain_token_positions(&res.tree, tres.starts, tres.lens, tres.token_amt);
+    }
   #ifdef TIME_PARSER
     res.perf_values = perf_end(perf_state);
   #endif
     return res;
   }
 
-  parse_tree_res parse(token *tokens, size_t token_amt) {
-    return parse_internal(tokens, token_amt, true);
+  parse_tree_res parse_with_driver(tokens_res tres, parser_driver driver) {
+    return parse_internal(tres, driver, false);
+  }
+
+#ifdef TABLE_DRIVEN_PARSER
+  #define DEFAULT_PARSER_DRIVER PARSER_DRIVER_TABLE
+#else
+  #define DEFAULT_PARSER_DRIVER PARSER_DRIVER_LEMON
+#endif
+
+  parse_tree_res parse(tokens_res tres) {
+    return parse_internal(tres, DEFAULT_PARSER_DRIVER, false);
+  }
+
+  parse_tree_res parse_slice(tokens_res tres) {
+    return parse_internal(tres, DEFAULT_PARSER_DRIVER, true);
   }
+
+  // If there's a stream, we wait for it before scanning past its frontier.
+  // Otherwise, `len` is the source's length.
+  static parse_tree_res scan_and_parse_internal(source_file file, size_t len, input_stream *stream, tokens_res *tres) {
+#ifdef TIME_PARSER
+    perf_state perf_state = perf_start();
+#endif
+    yyParser xp;
+    ParseInit(&xp);
+    parse_state state = parse_state_new();
+    if (stream == NULL) {
+      // Every token but EOF is at least a byte long. Pages past the last
+      // token are never touched, and the tree gives them back.
+      VEC_RESERVE(&state.token_starts, len + 1);
+      VEC_RESERVE(&state.token_lens, len + 1);
+    }
+
+    tres->succeeded = true;
+    tres->starts = NULL;
+    tres->symbols = NULL;
+    tres->lens = NULL;
+    tres->types = NULL;
+    tres->symbol_table = symbol_table_new();
+#ifdef TIME_TOKENIZER
+    tres->perf_values = perf_zero;
+#endif
+
+    buf_ind_t ind = 0;
+    buf_ind_t frontier = stream == NULL ? BUF_IND_MAX : 0;
+    for (;; state.pos++) {
+      if (HEDLEY_UNLIKELY(ind >= frontier)) {
+        frontier = input_stream_wait(stream, ind);
+      }
+      token_res tok_res = scan(file, ind);
+      if (!tok_res.succeeded) {
+        tres->succeeded = false;
+        tres->error_pos = tok_res.tok.start;
+        // the tree is incomplete, but we haven't seen a parse error
+        state.success = false;
+        break;
+      }
+      VEC_PUSH(&state.token_starts, tok_res.tok.start);
+      VEC_PUSH(&state.token_lens, tok_res.tok.len);
+      state.recent_symbols[state.pos % 2] =
+        intern_token(tres->symbol_table, file, tok_res.tok);
+      // the vecs may have moved
+      state.tokens = (token_arrays){
+        .starts = VEC_DATA_PTR(&state.token_starts),
+        .lens = VEC_DATA_PTR(&state.token_lens),
+        .symbols = NULL,
+        .amt = state.token_starts.len,
+      };
+      Parse(&xp, tok_res.tok.type, state.pos, &state);
+      // Nothing after the first parse error gets reported anyway
+      if (tok_res.tok.type == TK_EOF || !state.success) {
+        state.pos++;
+        break;
+      }
+      ind = tok_res.tok.start + tok_res.tok.len;
+    }
+    tres->token_amt = state.pos;
+    if (tres->succeeded) {
+      Parse(&xp, 0, state.pos, &state);
+    }
+    ParseFinalize(&xp);
+
+    parse_tree_res res = parse_state_finalize(&state);
+    if (res.success) {
+      // The tree takes the positions as they are, less the spare room
+      res.tree.token_amt = state.token_starts.len;
+      res.tree.token_starts = VEC_FINALIZE(&state.token_starts);
+      res.tree.token_lens = VEC_FINALIZE(&state.token_lens);
+    } else {
+      VEC_FREE(&state.token_starts);
+      VEC_FREE(&state.token_lens);
+    }
+  #ifdef TIME_PARSER
+    res.perf_values = perf_end(perf_state);
+  #endif
+    return res;
+  }
+
+  parse_tree_res scan_and_parse(source_file file, tokens_res *tres) {
+    return scan_and_parse_len(file, strlen(file.data), tres);
+  }
+
+  parse_tree_res scan_and_parse_len(source_file file, size_t len, tokens_res *tres) {
+    // Streams enforce the limit as they read
+    if (HEDLEY_UNLIKELY(len > SOURCE_LEN_MAX)) {
+      *tres = (tokens_res){.succeeded = false, .too_long = true};
+      return (parse_tree_res){.success = false};
+    }
+    return scan_and_parse_internal(file, len, NULL, tres);
+  }
+
+  parse_tree_res scan_and_parse_stream(input_stream *stream, tokens_res *tres) {
+    source_file file = {
+      .path = NULL,
+      .data = stream->data,
+    };
+    return scan_and_parse_internal(file, 0, stream, tres);
+  }
+
 }
@@ -90,7 +90,8 @@ typedef struct {
 
 perf_values perf_end(perf_state state) {
   ioctl(state.group_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
-  perf_values res;
+  // counters we couldn't open or read stay at zero
+  perf_values res = perf_zero;
   res.time_taken = time_since_monotonic(state.start_time);
   if (state.num_successful_subscriptions > 0) {
     read_format results;
@@ -7,7 +7,7 @@
 #include "typecheck.h"
 
 COLD_ATTR
-static void print_tc_error(FILE *f, tc_res res, const char *restrict input,
+static void print_tc_error(FILE *f, tc_res res, const line_index *lines,
                            parse_tree tree, node_ind_t err_ind) {
   tc_error error = res.errors[err_ind];
   // TODO be informative, add provenance, etc.
@@ -40,22 +40,21 @@ static void print_tc_error(FILE *f, tc_res res, const char *restrict input,
                  error.data.ambiguous.index);
       break;
   }
-  parse_node node = tree.nodes[error.pos];
-  position_info pos = find_line_and_col(input, node.phase_data.span.start);
+  span span = pt_node_span(&tree, error.pos);
+  position_info pos = find_line_and_col(lines, span.start);
   fprintf(f,
           "\nAt %s at %d:%d\n",
-          parse_node_strings[node.type.all],
+          parse_node_strings[PT_NODE_TAG(tree, error.pos)],
           pos.line,
           pos.column);
-  format_error_ctx(
-    f, input, node.phase_data.span.start, node.phase_data.span.len);
+  format_error_ctx(f, lines, span.start, span.len);
 }
 
 COLD_ATTR
-void print_tc_errors(FILE *f, const char *restrict input, parse_tree tree,
+void print_tc_errors(FILE *f, const line_index *lines, parse_tree tree,
                      tc_res res) {
   for (size_t i = 0; i < res.error_amt; i++) {
     putc('\n', f);
-    print_tc_error(f, res, input, tree, i);
+    print_tc_error(f, res, lines, tree, i);
   }
 }
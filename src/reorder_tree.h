@@ -1,9 +0,0 @@
-// Copyright 2023 The piq Authors. All rights reserved.
-// Use of this source code is governed by a BSD-style
-// license that can be found in the LICENSE file.
-
-#pragma once
-
-#include "parse_tree.h"
-
-parse_tree reorder_tree(parse_tree in);
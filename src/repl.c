@@ -17,28 +17,28 @@
 
 static void reply(char *input, FILE *out) {
   source_file test_file = {.path = "parser-test", .data = input};
+  line_index lines = build_line_index(input);
   tokens_res tres = scan_all(test_file);
   if (!tres.succeeded) {
-    puts("Tokenization failed:\n");
-    format_error_ctx(stdout, input, tres.error_pos, 1);
+    print_tokens_error(stdout, &lines, tres);
     putc('\n', stdout);
     goto end_a;
   }
 
-  parse_tree_res pres = parse(tres.tokens, tres.token_amt);
+  parse_tree_res pres = parse(tres);
   if (!pres.success) {
-    print_parse_errors(stdout, input, tres.tokens, pres.errors);
+    print_parse_errors(stdout, &lines, pres.errors);
     putc('\n', stdout);
     goto end_b;
   }
 
   resolution_res res_res = resolve_bindings(pres.tree, input);
   if (res_res.not_found.binding_amt > 0) {
-    print_resolution_errors(stdout, input, res_res.not_found);
+    print_resolution_errors(stdout, &lines, res_res.not_found);
   }
   tc_res tc_res = typecheck(pres.tree);
   if (tc_res.error_amt > 0) {
-    print_tc_errors(stdout, input, pres.tree, tc_res);
+    print_tc_errors(stdout, &lines, pres.tree, tc_res);
     putc('\n', stdout);
     goto end_c;
   }
@@ -54,6 +54,7 @@ end_b:
 
 end_a:
   free_tokens_res(tres);
+  free_line_index(lines);
 }
 
 int repl(void) {
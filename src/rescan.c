@@ -0,0 +1,162 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "token.h"
+#include "util.h"
+#include "vec.h"
+
+// The scanner never looks more than one byte past the end of a token it
+// accepts, and it's stateless, so:
+//
+// * A token that ends before the edit, with its lookahead byte also before
+//   the edit, is unaffected, as is every token before it.
+// * Once the new source produces a token at the (shifted) start of an old
+//   token from after the edit, everything from there on is the same as
+//   before, just shifted.
+
+// Index of the first token whose lookahead byte is at or after `pos`
+static size_t first_token_reaching(const tokens_res *res, buf_ind_t pos) {
+  size_t lo = 0;
+  size_t hi = res->token_amt;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (res->starts[mid] + res->lens[mid] < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Index of the first token that starts at or after `pos`
+static size_t first_token_starting_from(const tokens_res *res,
+                                        buf_ind_t pos) {
+  size_t lo = 0;
+  size_t hi = res->token_amt;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (res->starts[mid] < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void rescan_fail(tokens_res *res, buf_ind_t error_pos) {
+  // the symbol table is left for free_tokens_res
+  free(res->symbols);
+  res->starts = NULL;
+  res->symbols = NULL;
+  res->lens = NULL;
+  res->types = NULL;
+  res->token_amt = 0;
+  res->token_cap = 0;
+  res->succeeded = false;
+  res->error_pos = error_pos;
+}
+
+void rescan_edit(tokens_res *res, source_file file, source_edit edit) {
+  debug_assert(edit.start <= edit.old_end && edit.start <= edit.new_end);
+
+  if (!res->succeeded) {
+    free_tokens_res(*res);
+    *res = scan_all(file);
+    return;
+  }
+
+  // EOF starts at the source's length, so we can check the new length
+  // without measuring the file, and let scan_all report it
+  const size_t new_len =
+    (size_t)res->starts[res->token_amt - 1] - edit.old_end + edit.new_end;
+  if (HEDLEY_UNLIKELY(new_len > SOURCE_LEN_MAX)) {
+    free_tokens_res(*res);
+    *res = scan_all(file);
+    return;
+  }
+
+#ifdef TIME_TOKENIZER
+  perf_state perf_state = perf_start();
+#endif
+
+  const size_t keep = first_token_reaching(res, edit.start);
+  size_t old_ind = first_token_starting_from(res, edit.old_end);
+  // Wraps around for deletions, which is fine, as starts are unsigned
+  const buf_ind_t shift = edit.new_end - edit.old_end;
+
+  buf_ind_t ind = keep == 0 ? 0 : res->starts[keep - 1] + res->lens[keep - 1];
+  vec_token scanned = VEC_NEW;
+  for (;;) {
+    const token_res tres = scan(file, ind);
+    if (!tres.succeeded) {
+      VEC_FREE(&scanned);
+      rescan_fail(res, tres.tok.start);
+#ifdef TIME_TOKENIZER
+      res->perf_values = perf_end(perf_state);
+#endif
+      return;
+    }
+    // Old tokens are at or after the edit, so shifting them can't underflow,
+    // as long as the sum wraps like a buf_ind_t
+    while (old_ind < res->token_amt &&
+           (buf_ind_t)(res->starts[old_ind] + shift) < tres.tok.start) {
+      old_ind++;
+    }
+    if (old_ind < res->token_amt &&
+        (buf_ind_t)(res->starts[old_ind] + shift) == tres.tok.start)
+      break;
+    // The old EOF always lines up, unless the edit doesn't match the file
+    debug_assert(tres.tok.type != TK_EOF);
+    VEC_PUSH(&scanned, tres.tok);
+    ind = tres.tok.start + tres.tok.len;
+  }
+
+  const size_t suffix_amt = res->token_amt - old_ind;
+  const size_t suffix_at = keep + scanned.len;
+  const size_t token_amt = suffix_at + suffix_amt;
+  if (token_amt > res->token_cap) {
+    VEC_FREE(&scanned);
+    free_tokens_res(*res);
+    *res = scan_all(file);
+    return;
+  }
+
+  memmove(res->starts + suffix_at,
+          res->starts + old_ind,
+          suffix_amt * sizeof(buf_ind_t));
+  memmove(res->symbols + suffix_at,
+          res->symbols + old_ind,
+          suffix_amt * sizeof(symbol_id));
+  memmove(res->lens + suffix_at,
+          res->lens + old_ind,
+          suffix_amt * sizeof(token_len_t));
+  memmove(res->types + suffix_at,
+          res->types + old_ind,
+          suffix_amt * sizeof(token_type));
+  if (shift != 0) {
+    for (size_t i = suffix_at; i < token_amt; i++) {
+      res->starts[i] += shift;
+    }
+  }
+
+  for (size_t i = 0; i < scanned.len; i++) {
+    const token t = VEC_GET(scanned, i);
+    res->starts[keep + i] = t.start;
+    res->symbols[keep + i] = intern_token(res->symbol_table, file, t);
+    res->lens[keep + i] = t.len;
+    res->types[keep + i] = t.type;
+  }
+  res->token_amt = token_amt;
+  VEC_FREE(&scanned);
+
+#ifdef TIME_TOKENIZER
+  res->perf_values = perf_end(perf_state);
+#endif
+}
@@ -17,19 +17,6 @@
 #include "util.h"
 #include "vec.h"
 
-// For a known-length, and a null-terminated string
-static bool strn1eq(const char *a, const char *b, size_t alen) {
-  size_t i;
-  for (i = 0; i < alen; i++) {
-    // handles b '\0'
-    if (a[i] != b[i])
-      return false;
-  }
-  if (b[i] != '\0')
-    return false;
-  return true;
-}
-
 // This extremely simple string comparison improved compile time by about 3-4%
 static bool streq(const char *restrict a, const char *restrict b,
                   buf_ind_t len) {
@@ -41,18 +28,23 @@ static bool streq(const char *restrict a, const char *restrict b,
   return true;
 }
 
-// TODO consider separating builtins into separate array somehow
-// Find index of binding, return bindings.len if not found
-static node_ind_t lookup_str_ref(const char *source_file, scope scope,
-                                 binding bnd) {
+// The environment index that the next binding will get
+static environment_ind_t scope_len(scope scope) {
+  return scope.builtin_amt + scope.bindings.len;
+}
+
+// Find the environment index of a user binding, return scope_len if not found
+static environment_ind_t lookup_binding(const char *source_file, scope scope,
+                                        binding bnd) {
   resolve_map_ctx ctx = {
     .scope = &scope,
     .source_file = source_file,
   };
   u32 bucket_ind = ahm_lookup(&scope.map, &bnd, &ctx);
-  return bs_get(scope.map.occupied, bucket_ind)
-           ? ((environment_ind_t *)scope.map.keys)[bucket_ind]
-           : scope.bindings.len;
+  return scope.builtin_amt +
+         (bs_get(scope.map.occupied, bucket_ind)
+            ? ((environment_ind_t *)scope.map.keys)[bucket_ind]
+            : scope.bindings.len);
 }
 
 static bool cmp_bnd(const void *bnd_p, const void *ind_p, const void *ctx_p) {
@@ -60,25 +52,15 @@ static bool cmp_bnd(const void *bnd_p, const void *ind_p, const void *ctx_p) {
   const environment_ind_t bnd_ind = *((environment_ind_t *)ind_p);
   const resolve_map_ctx ctx = *((resolve_map_ctx *)ctx_p);
   const char *bndp = ctx.source_file + bnd.start;
-  const str_ref a = VEC_GET(ctx.scope->bindings, bnd_ind);
-  bool res = false;
-  if (bs_get(ctx.scope->is_builtin, bnd_ind)) {
-    if (*bndp == *a.builtin && strn1eq(bndp, a.builtin, bnd.len)) {
-      res = true;
-    }
-  } else {
-    const char *b = &ctx.source_file[a.binding.start];
-    if (a.binding.len == bnd.len && *bndp == *b && streq(bndp, b, bnd.len)) {
-      res = true;
-    }
-  }
-  return res;
+  const binding a = VEC_GET(ctx.scope->bindings, bnd_ind);
+  const char *b = &ctx.source_file[a.start];
+  return a.len == bnd.len && *bndp == *b && streq(bndp, b, bnd.len);
 }
 
-static scope scope_new(void) {
+static scope scope_new(environment_ind_t builtin_amt) {
   scope res = {
+    .builtin_amt = builtin_amt,
     .bindings = VEC_NEW,
-    .is_builtin = bs_new(),
     .shadows = VEC_NEW,
     .map = hashset_new(
       environment_ind_t, cmp_bnd, hash_binding, hash_stored_binding),
@@ -86,202 +68,300 @@ static scope scope_new(void) {
   return res;
 }
 
+// The map holds indices into the scope's bindings, rather than environment
+// indices, as it never holds builtins
 static void scope_push(const char *source_file, scope *s, binding b) {
-  str_ref str = {
-    .binding = b,
-  };
   resolve_map_ctx ctx = {
     .scope = s,
     .source_file = source_file,
   };
   ahm_maybe_rehash(&s->map, &ctx);
   u32 bucket_ind = ahm_lookup(&s->map, &b, &ctx);
-  u32 prev = bs_get(s->map.occupied, bucket_ind)
-               ? ((environment_ind_t *)s->map.keys)[bucket_ind]
-               : s->bindings.len;
-  bs_push_false(&s->is_builtin);
-  VEC_PUSH(&s->bindings, str);
+  environment_ind_t prev = bs_get(s->map.occupied, bucket_ind)
+                             ? ((environment_ind_t *)s->map.keys)[bucket_ind]
+                             : s->bindings.len;
+  VEC_PUSH(&s->bindings, b);
   VEC_PUSH(&s->shadows, prev);
   const environment_ind_t key_stored = s->bindings.len - 1;
   ahm_insert_at(&s->map, bucket_ind, &key_stored, NULL);
 }
 
 static void scope_free(scope s) {
-  bs_free(&s.is_builtin);
   VEC_FREE(&s.bindings);
   VEC_FREE(&s.shadows);
   ahm_free(&s.map);
 }
 
+static void resolve_pop_env(const char *source_file, scope *env) {
+  resolve_map_ctx ctx = {
+    .scope = env,
+    .source_file = source_file,
+  };
+  environment_ind_t vec_ind = env->bindings.len - 1;
+  const u32 bucket_ind = ahm_remove_stored(&env->map, &vec_ind, &ctx);
+  VEC_POP_(&env->bindings);
+  environment_ind_t prev;
+  VEC_POP(&env->shadows, &prev);
+  if (prev < env->bindings.len) {
+    ahm_insert_at(&env->map, bucket_ind, &prev, NULL);
+  }
+}
+
+// Once a symbol's been seen, its innermost binding is an array lookup, as are
+// pushes and pops. There's no hashing, or string comparison, except to look
+// a symbol up in the builtins the first time it misses.
+#define SYMBOL_UNSEEN ((environment_ind_t)-1)
+
+static symbol_scope symbol_scope_new(environment_ind_t builtin_amt) {
+  symbol_scope res = {
+    .builtin_amt = builtin_amt,
+    .innermost = NULL,
+    .symbol_amt = 0,
+    .bound = VEC_NEW,
+    .shadows = VEC_NEW,
+  };
+  return res;
+}
+
+static environment_ind_t symbol_scope_len(const symbol_scope *s) {
+  return s->builtin_amt + s->bound.len;
+}
+
+// Symbols are dense, and numbered in order of appearance, so this is rarely
+// more than one symbol at a time
+static void symbol_scope_reserve(symbol_scope *s, symbol_id sym) {
+  if (HEDLEY_LIKELY(sym < s->symbol_amt)) {
+    return;
+  }
+  const u32 amt = MAX((u32)sym + 1, s->symbol_amt * 2);
+  s->innermost = realloc(s->innermost, sizeof(environment_ind_t) * amt);
+  for (u32 i = s->symbol_amt; i < amt; i++) {
+    s->innermost[i] = SYMBOL_UNSEEN;
+  }
+  s->symbol_amt = amt;
+}
+
+static void symbol_scope_push(symbol_scope *s, symbol_id sym) {
+  symbol_scope_reserve(s, sym);
+  VEC_PUSH(&s->bound, sym);
+  VEC_PUSH(&s->shadows, s->innermost[sym]);
+  s->innermost[sym] = symbol_scope_len(s) - 1;
+}
+
+static void symbol_scope_pop(symbol_scope *s) {
+  symbol_id sym;
+  environment_ind_t prev;
+  VEC_POP(&s->bound, &sym);
+  VEC_POP(&s->shadows, &prev);
+  s->innermost[sym] = prev;
+}
+
+static void symbol_scope_free(symbol_scope s) {
+  free(s.innermost);
+  VEC_FREE(&s.bound);
+  VEC_FREE(&s.shadows);
+}
+
 typedef struct {
+  resolver resolver;
   vec_binding not_found;
   parse_tree tree;
   const char *restrict input;
   pt_traverse_elem elem;
+  // RESOLVER_HASHED
   scope environment;
   scope type_environment;
+  // RESOLVER_SYMBOLS
+  symbol_scope symbol_environment;
+  symbol_scope symbol_type_environment;
   u32 num_names_looked_up;
 } scope_calculator_state;
 
+// The environment index that the next term binding will get
+static environment_ind_t environment_len(const scope_calculator_state *state) {
+  switch (state->resolver) {
+    case RESOLVER_HASHED:
+      return scope_len(state->environment);
+    case RESOLVER_SYMBOLS:
+      return symbol_scope_len(&state->symbol_environment);
+  }
+  return 0;
+}
+
+static void push_binding(scope_calculator_state *state, node_ind_t node_ind) {
+  switch (state->resolver) {
+    case RESOLVER_HASHED:
+      scope_push(state->input,
+                 &state->environment,
+                 PT_LEAF_SPAN(state->tree, node_ind));
+      break;
+    case RESOLVER_SYMBOLS:
+      symbol_scope_push(&state->symbol_environment,
+                        PT_NODE_DATA(state->tree, node_ind).var_data.symbol);
+      break;
+  }
+}
+
+static void pop_binding(scope_calculator_state *state) {
+  switch (state->resolver) {
+    case RESOLVER_HASHED:
+      resolve_pop_env(state->input, &state->environment);
+      break;
+    case RESOLVER_SYMBOLS:
+      symbol_scope_pop(&state->symbol_environment);
+      break;
+  }
+}
+
+// Returns the scope's length if the name isn't bound
+static environment_ind_t lookup_hashed(scope_calculator_state *state,
+                                       scope scope, bool is_type,
+                                       span span) {
+  environment_ind_t index = lookup_binding(state->input, scope, span);
+  // User bindings shadow builtins, so builtins only get a look in after a miss
+  if (index == scope_len(scope)) {
+    const char *name = state->input + span.start;
+    const environment_ind_t builtin =
+      is_type ? lookup_builtin_type(name, span.len)
+              : lookup_builtin_term(name, span.len);
+    if (builtin < scope.builtin_amt) {
+      index = builtin;
+    }
+  }
+  return index;
+}
+
+// Returns the scope's length if the name isn't bound
+static environment_ind_t lookup_symbol(scope_calculator_state *state,
+                                       symbol_scope *scope, bool is_type,
+                                       symbol_id sym, span span) {
+  symbol_scope_reserve(scope, sym);
+  environment_ind_t index = scope->innermost[sym];
+  if (HEDLEY_UNLIKELY(index == SYMBOL_UNSEEN)) {
+    // Nothing binds the symbol, so its builtin, if it has one, can go at the
+    // bottom of its chain
+    const char *name = state->input + span.start;
+    const environment_ind_t builtin =
+      is_type ? lookup_builtin_type(name, span.len)
+              : lookup_builtin_term(name, span.len);
+    if (builtin < scope->builtin_amt) {
+      scope->innermost[sym] = builtin;
+      index = builtin;
+    } else {
+      index = symbol_scope_len(scope);
+    }
+  }
+  return index;
+}
+
 // Setting the binding's bariable_index to the thing we're about to push
 // is theoretically unnecessary work, but it's nit to have a concreate
 // index to look things up with in eg. the llvm stage.
 static void precalculate_scope_push(scope_calculator_state *state) {
+  node_ind_t binding_ind;
   switch (state->elem.data.node_data.node.type.binding) {
-    case PT_BIND_FUN: {
-      node_ind_t binding_ind =
+    case PT_BIND_FUN:
+      binding_ind =
         PT_FUN_BINDING_IND(state->tree.inds, state->elem.data.node_data.node);
-      parse_node *binding_node = &state->tree.nodes[binding_ind];
-      binding b = binding_node->phase_data.span;
-      binding_node->data.var_data.variable_index =
-        state->environment.bindings.len;
-      scope_push(state->input, &state->environment, b);
       break;
-    }
-    case PT_BIND_WILDCARD: {
-      parse_node *node =
-        &state->tree.nodes[state->elem.data.node_data.node_index];
-      node->data.var_data.variable_index = state->environment.bindings.len;
-      binding b = node->phase_data.span;
-      scope_push(state->input, &state->environment, b);
+    case PT_BIND_WILDCARD:
+      binding_ind = state->elem.data.node_data.node_index;
       break;
-    }
-    case PT_BIND_LET: {
-      node_ind_t binding_ind = PT_LET_BND_IND(state->elem.data.node_data.node);
-      parse_node *node = &state->tree.nodes[binding_ind];
-      node->data.var_data.variable_index = state->environment.bindings.len;
-      binding b = node->phase_data.span;
-      scope_push(state->input, &state->environment, b);
+    case PT_BIND_LET:
+      binding_ind = PT_LET_BND_IND(state->elem.data.node_data.node);
       break;
-    }
+    default:
+      return;
   }
+  PT_NODE_DATA(state->tree, binding_ind).var_data.variable_index =
+    environment_len(state);
+  push_binding(state, binding_ind);
 }
 
 static void precalculate_scope_visit(scope_calculator_state *state) {
   parse_node node = state->elem.data.node_data.node;
-  scope *scope_p;
+  node_ind_t node_ind = state->elem.data.node_data.node_index;
+  bool is_type;
   switch (node.type.all) {
     case PT_ALL_TY_PARAM_NAME:
-    case PT_ALL_TY_CONSTRUCTOR_NAME: {
-      scope_p = &state->type_environment;
+    case PT_ALL_TY_CONSTRUCTOR_NAME:
+      is_type = true;
       break;
-    }
     case PT_ALL_EX_TERM_NAME:
-    case PT_ALL_EX_UPPER_NAME: {
-      scope_p = &state->environment;
+    case PT_ALL_EX_UPPER_NAME:
+      is_type = false;
       break;
-    }
     default:
       return;
   }
-  scope scope = *scope_p;
   state->num_names_looked_up++;
-  VEC_LEN_T index = lookup_str_ref(state->input, scope, node.phase_data.span);
-  if (index == scope.bindings.len) {
-    VEC_PUSH(&state->not_found, node.phase_data.span);
+  span span = PT_LEAF_SPAN(state->tree, node_ind);
+  environment_ind_t index;
+  bool found;
+  switch (state->resolver) {
+    case RESOLVER_HASHED: {
+      scope scope = is_type ? state->type_environment : state->environment;
+      index = lookup_hashed(state, scope, is_type, span);
+      found = index != scope_len(scope);
+      break;
+    }
+    case RESOLVER_SYMBOLS: {
+      symbol_scope *scope = is_type ? &state->symbol_type_environment
+                                    : &state->symbol_environment;
+      index = lookup_symbol(
+        state, scope, is_type, node.data.var_data.symbol, span);
+      found = index != symbol_scope_len(scope);
+      break;
+    }
+    default:
+      return;
   }
-  state->tree.nodes[state->elem.data.node_data.node_index]
-    .data.var_data.variable_index = index;
-}
-
-static void resolve_pop_env(scope_calculator_state *state) {
-  scope *env = &state->environment;
-  resolve_map_ctx ctx = {
-    .scope = env,
-    .source_file = state->input,
-  };
-  VEC_LEN_T vec_ind = env->bindings.len - 1;
-  const u32 bucket_ind = ahm_remove_stored(&env->map, &vec_ind, &ctx);
-  bs_pop(&env->is_builtin);
-  str_ref ref;
-  VEC_POP(&env->bindings, &ref);
-  environment_ind_t prev;
-  VEC_POP(&env->shadows, &prev);
-  if (prev < env->bindings.len) {
-    ahm_insert_at(&env->map, bucket_ind, &prev, NULL);
+  if (!found) {
+    VEC_PUSH(&state->not_found, span);
   }
+  PT_NODE_DATA(state->tree, node_ind).var_data.variable_index = index;
 }
 
-resolution_res resolve_bindings(parse_tree tree, const char *restrict input) {
-  pt_traversal traversal = pt_walk(tree, TRAVERSE_RESOLVE_BINDINGS);
-  scope_calculator_state state = {
-    .not_found = VEC_NEW,
-    .tree = tree,
-    .input = input,
-    .environment = scope_new(),
-    .type_environment = scope_new(),
-    .num_names_looked_up = 0,
-  };
+static resolution_res resolve_bindings_internal(
+  scope_calculator_state *state) {
+  pt_traversal traversal = pt_walk(state->tree, TRAVERSE_RESOLVE_BINDINGS);
 
 #ifdef TIME_NAME_RESOLUTION
   perf_state perf_state = perf_start();
 #endif
 
-  bs_push_true_n(&state.type_environment.is_builtin, named_builtin_type_amount);
-  bs_push_true_n(&state.environment.is_builtin, builtin_term_amount);
-
-  {
-    resolve_map_ctx ctx = {
-      .scope = &state.type_environment,
-      .source_file = state.input,
-    };
-
-    for (environment_ind_t i = 0; i < named_builtin_type_amount; i++) {
-      str_ref s = {.builtin = builtin_type_names[i]};
-      VEC_PUSH(&state.type_environment.shadows, i);
-      VEC_PUSH(&state.type_environment.bindings, s);
-      ahm_insert_stored(&state.type_environment.map, &i, NULL, &ctx);
-    }
-  }
-
-  {
-    resolve_map_ctx ctx = {
-      .scope = &state.environment,
-      .source_file = state.input,
-    };
-
-    for (node_ind_t i = 0; i < builtin_term_amount; i++) {
-      str_ref s = {.builtin = builtin_term_names[i]};
-      VEC_PUSH(&state.environment.shadows, i);
-      VEC_PUSH(&state.environment.bindings, s);
-      ahm_insert_stored(&state.environment.map, &i, NULL, &ctx);
-    }
-  }
-
   while (true) {
-    state.elem = pt_walk_next(&traversal);
-    switch (state.elem.action) {
+    state->elem = pt_walk_next(&traversal);
+    switch (state->elem.action) {
       case TR_POP_TO: {
-        const u32 to_pop = state.environment.bindings.len -
-                           state.elem.data.new_environment_amount;
+        const u32 to_pop =
+          environment_len(state) - state->elem.data.new_environment_amount;
         for (u32 i = 0; i < to_pop; i++) {
-          resolve_pop_env(&state);
+          pop_binding(state);
         }
         break;
       }
       case TR_END: {
-        const VEC_LEN_T len = state.not_found.len;
+        const VEC_LEN_T len = state->not_found.len;
         resolution_res res = {
           .not_found =
             {
               .binding_amt = len,
-              .bindings = VEC_FINALIZE(&state.not_found),
+              .bindings = VEC_FINALIZE(&state->not_found),
             },
 #ifdef TIME_NAME_RESOLUTION
           .perf_values = perf_end(perf_state),
-          .num_names_looked_up = state.num_names_looked_up,
+          .num_names_looked_up = state->num_names_looked_up,
 #endif
         };
-        scope_free(state.environment);
-        scope_free(state.type_environment);
         return res;
       }
       case TR_PREDECLARE_FN:
       case TR_PUSH_SCOPE_VAR:
-        precalculate_scope_push(&state);
+        precalculate_scope_push(state);
         break;
       case TR_VISIT_IN:
-        precalculate_scope_visit(&state);
+        precalculate_scope_visit(state);
         break;
       case TR_NEW_BLOCK:
       case TR_ANNOTATE:
@@ -290,3 +370,47 @@ resolution_res resolve_bindings(parse_tree tree, const char *restrict input) {
     }
   }
 }
+
+// The hashmaps can't be assigned, so each resolver initializes its own state
+resolution_res resolve_bindings_with(parse_tree tree,
+                                     const char *restrict input,
+                                     resolver resolver) {
+  switch (resolver) {
+    case RESOLVER_HASHED: {
+      scope_calculator_state state = {
+        .resolver = resolver,
+        .not_found = VEC_NEW,
+        .tree = tree,
+        .input = input,
+        .environment = scope_new(builtin_term_amount),
+        .type_environment = scope_new(named_builtin_type_amount),
+        .num_names_looked_up = 0,
+      };
+      resolution_res res = resolve_bindings_internal(&state);
+      scope_free(state.environment);
+      scope_free(state.type_environment);
+      return res;
+    }
+    case RESOLVER_SYMBOLS: {
+      scope_calculator_state state = {
+        .resolver = resolver,
+        .not_found = VEC_NEW,
+        .tree = tree,
+        .input = input,
+        .symbol_environment = symbol_scope_new(builtin_term_amount),
+        .symbol_type_environment =
+          symbol_scope_new(named_builtin_type_amount),
+        .num_names_looked_up = 0,
+      };
+      resolution_res res = resolve_bindings_internal(&state);
+      symbol_scope_free(state.symbol_environment);
+      symbol_scope_free(state.symbol_type_environment);
+      return res;
+    }
+  }
+  return (resolution_res){0};
+}
+
+resolution_res resolve_bindings(parse_tree tree, const char *restrict input) {
+  return resolve_bindings_with(tree, input, RESOLVER_SYMBOLS);
+}
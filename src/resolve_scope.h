@@ -5,18 +5,31 @@
 #pragma once
 
 #include "binding.h"
-#include "bitset.h"
 #include "parse_tree.h"
 #include "hashmap.h"
+#include "symbol_table.h"
 #include "vec.h"
 
+// Only holds user bindings. Builtins come first in the environment, but
+// they're looked up in builtins' own tables, when a name isn't in scope.
 typedef struct {
-  bitset is_builtin;
-  vec_str_ref bindings;
-  vec_u32 shadows;
+  environment_ind_t builtin_amt;
+  vec_binding bindings;
+  vec_environment_ind shadows;
   a_hashmap map;
 } scope;
 
+// Each symbol's innermost binding, indexed by the parser's symbol IDs, with
+// what each binding shadowed, to put back when it goes out of scope
+typedef struct {
+  environment_ind_t builtin_amt;
+  environment_ind_t *innermost;
+  u32 symbol_amt;
+  // the symbols bound since the builtins, innermost last
+  vec_symbol_id bound;
+  vec_environment_ind shadows;
+} symbol_scope;
+
 typedef struct {
   scope *scope;
   const char *source_file;
@@ -35,4 +48,16 @@ typedef struct {
 #endif
 } resolution_res;
 
+typedef enum {
+  // scopes are hashmaps of spellings
+  RESOLVER_HASHED,
+  // scopes are arrays indexed by the parser's symbol IDs
+  RESOLVER_SYMBOLS,
+} resolver;
+
+// Uses the symbol-indexed resolver
 resolution_res resolve_bindings(parse_tree tree, const char *restrict input);
+// For comparing resolvers, both are always built
+resolution_res resolve_bindings_with(parse_tree tree,
+                                     const char *restrict input,
+                                     resolver resolver);
@@ -383,6 +383,72 @@ static void put_perf_per_thing(put_metric_state *state, const char *operation,
 }
 #endif
 
+#ifdef TIME_PARSER
+static void put_parse_tree_stats(put_metric_state *state,
+                                 const parse_tree_stats *stats) {
+  {
+    amount_metric m = {
+      .name = "Parse tree index bytes",
+      .amount = stats->inds_bytes,
+    };
+    put_metric_byte_amount(state, m);
+  }
+
+  {
+    amount_metric m = {
+      .name = "Max parse tree depth",
+      .amount = stats->max_depth,
+    };
+    put_metric_amount(state, m);
+  }
+
+  {
+    float_metric m = {
+      .name = "Mean parse tree depth",
+      .amount = parse_tree_stats_mean_depth(stats),
+    };
+    put_metric_float(state, m);
+  }
+
+  for (unsigned i = 0; i < PT_FAN_OUT_BUCKET_AMT; i++) {
+    char *desc = format_to_string("Parse nodes with fan-out %s",
+                                  pt_fan_out_bucket_names[i]);
+    amount_metric m = {
+      .name = desc,
+      .amount = stats->fan_out[i],
+    };
+    put_metric_amount(state, m);
+    free(desc);
+  }
+
+  for (unsigned i = 0; i < parse_node_type_amount; i++) {
+    if (stats->nodes_by_type[i] == 0) {
+      continue;
+    }
+    {
+      char *desc =
+        format_to_string("%s parse nodes", pt_stats_type_names[i]);
+      amount_metric m = {
+        .name = desc,
+        .amount = stats->nodes_by_type[i],
+      };
+      put_metric_amount(state, m);
+      free(desc);
+    }
+    {
+      char *desc =
+        format_to_string("%s parse node bytes", pt_stats_type_names[i]);
+      amount_metric m = {
+        .name = desc,
+        .amount = stats->bytes_by_type[i],
+      };
+      put_metric_byte_amount(state, m);
+      free(desc);
+    }
+  }
+}
+#endif
+
 typedef struct {
   bool verbose;
   bool extra_verbose;
@@ -551,6 +617,19 @@ int main(int argc, char **argv) {
       put_metric_amount(&metric_state, m);
     }
 
+#ifdef PREDEF_OS_LINUX
+    // perf counters aren't always available, and inf isn't valid JSON
+    if (state.total_tokenization_perf.hw_cpu_cycles > 0) {
+      double ratio = (double)state.total_bytes_tokenized /
+                     (double)state.total_tokenization_perf.hw_cpu_cycles;
+      float_metric m = {
+        .name = "Tokenizer bytes per cycle",
+        .amount = ratio,
+      };
+      put_metric_float(&metric_state, m);
+    }
+#endif
+
     {
       const char *name = "Tokenizer";
       put_perf_per_thing(&metric_state,
@@ -564,6 +643,33 @@ int main(int argc, char **argv) {
                          state.total_tokens_produced,
                          state.total_tokenization_perf);
     }
+
+    if (state.total_rescans > 0) {
+      put_perf_timings(
+        &metric_state, "incremental rescans", state.total_rescan_perf);
+      put_perf_per_thing(&metric_state,
+                         "Incremental rescan",
+                         "edit",
+                         state.total_rescans,
+                         state.total_rescan_perf);
+    }
+  }
+
+  if (state.total_int_literals_parsed > 0) {
+    metric_state.heading = METRIC_H_TOKENIZER;
+
+    put_perf_timings(
+      &metric_state, "integer literal parsing", state.total_int_literal_perf);
+    put_perf_per_thing(&metric_state,
+                       "Integer literal parsing",
+                       "literal",
+                       state.total_int_literals_parsed,
+                       state.total_int_literal_perf);
+    put_perf_per_thing(&metric_state,
+                       "Integer literal parsing",
+                       "byte",
+                       state.total_int_literal_bytes,
+                       state.total_int_literal_perf);
   }
 #endif
 
@@ -612,6 +718,32 @@ int main(int argc, char **argv) {
                          state.total_parse_nodes_produced,
                          state.total_parser_perf);
     }
+
+    put_parse_tree_stats(&metric_state, &state.total_parse_tree_stats);
+  }
+
+  if (state.total_lemon_driver_tokens > 0) {
+    metric_state.heading = METRIC_H_PARSER;
+
+    put_perf_timings(
+      &metric_state, "lemon's parser driver", state.total_lemon_driver_perf);
+    put_perf_per_thing(&metric_state,
+                       "Lemon's parser driver",
+                       "token",
+                       state.total_lemon_driver_tokens,
+                       state.total_lemon_driver_perf);
+  }
+
+  if (state.total_table_driver_tokens > 0) {
+    metric_state.heading = METRIC_H_PARSER;
+
+    put_perf_timings(
+      &metric_state, "table parser driver", state.total_table_driver_perf);
+    put_perf_per_thing(&metric_state,
+                       "Table parser driver",
+                       "token",
+                       state.total_table_driver_tokens,
+                       state.total_table_driver_perf);
   }
 #endif
 
@@ -642,6 +774,31 @@ int main(int argc, char **argv) {
       // state.total_parse_nodes_resolved, state.total_name_resolution_time);
     }
   }
+
+  if (state.total_hashed_resolver_names > 0) {
+    metric_state.heading = METRIC_H_RESOLVE_NAMES;
+
+    put_perf_timings(
+      &metric_state, "hashed name resolver", state.total_hashed_resolver_perf);
+    put_perf_per_thing(&metric_state,
+                       "Hashed name resolver",
+                       "name looked up",
+                       state.total_hashed_resolver_names,
+                       state.total_hashed_resolver_perf);
+  }
+
+  if (state.total_symbol_resolver_names > 0) {
+    metric_state.heading = METRIC_H_RESOLVE_NAMES;
+
+    put_perf_timings(&metric_state,
+                     "symbol-indexed name resolver",
+                     state.total_symbol_resolver_perf);
+    put_perf_per_thing(&metric_state,
+                       "Symbol-indexed name resolver",
+                       "name looked up",
+                       state.total_symbol_resolver_names,
+                       state.total_symbol_resolver_perf);
+  }
 #endif
 
 #ifdef TIME_TYPECHECK
@@ -0,0 +1,254 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "symbol_table.h"
+#include "token.h"
+#include "util.h"
+#include "vec.h"
+
+// Below this, starting a thread costs more than scanning the chunk
+#define MIN_CHUNK_BYTES (256 * 1024)
+
+// Chunks are scanned independently, and only merged once they're all done.
+//
+// The scanner is stateless, so a chunk's tokens are correct from the first
+// token the serial scanner would also have started at. We try to cut chunks
+// just before a top-level form, where that's the chunk's first token, but if
+// we guess wrong (eg. the cut is in a string), merging falls back to the
+// serial scanner until it lines up with the chunk's tokens again.
+//
+// Every token other than EOF consumes at least one byte, so the tokens
+// starting before byte `n` fit before index `n`. Each chunk writes its tokens
+// straight into the result, from the index of its first byte, and merging
+// moves them down into place.
+typedef struct {
+  source_file file;
+  buf_ind_t begin;
+  buf_ind_t end;
+  // Shared by every chunk
+  tokens_res *res;
+  // Tokens starting in [begin, end), at [begin, begin + token_amt)
+  size_t token_amt;
+  // Names are interned per chunk, and given their final IDs, in order, when
+  // merging
+  symbol_table *symbol_table;
+  // The scan result that stopped us. Either a token starting at or after
+  // `end`, EOF, or a failure.
+  token_res last;
+} scan_chunk;
+
+static void *scan_chunk_worker(void *arg) {
+  scan_chunk *chunk = arg;
+  chunk->symbol_table = symbol_table_new();
+  tokens_res *res = chunk->res;
+  size_t i = chunk->begin;
+  buf_ind_t ind = chunk->begin;
+  for (;;) {
+    token_res tres = scan(chunk->file, ind);
+    if (!tres.succeeded || tres.tok.type == TK_EOF ||
+        tres.tok.start >= chunk->end) {
+      chunk->last = tres;
+      break;
+    }
+    res->starts[i] = tres.tok.start;
+    res->lens[i] = tres.tok.len;
+    res->types[i] = tres.tok.type;
+    res->symbols[i] =
+      intern_token(chunk->symbol_table, chunk->file, tres.tok);
+    i++;
+    ind = tres.tok.start + tres.tok.len;
+  }
+  chunk->token_amt = i - chunk->begin;
+  return NULL;
+}
+
+// Prefer cutting just before a paren at the start of a line, which is almost
+// always a top-level form
+static buf_ind_t find_cut(const char *data, buf_ind_t target, buf_ind_t limit) {
+  for (const char *c = data + target; c < data + limit; c++) {
+    c = memchr(c, '\n', data + limit - c);
+    if (c == NULL)
+      break;
+    if (c[1] == '(')
+      return c + 1 - data;
+  }
+  return target;
+}
+
+static void push_token(tokens_res *res, source_file file, token t) {
+  res->starts[res->token_amt] = t.start;
+  res->lens[res->token_amt] = t.len;
+  res->types[res->token_amt] = t.type;
+  res->symbols[res->token_amt] = intern_token(res->symbol_table, file, t);
+  res->token_amt++;
+}
+
+// Moves `amt` of a chunk's tokens to `dest`, after everything that's in place
+// already. They usually move down, but can move up a little, if the serial
+// scanner found more tokens than the chunk did before they lined up. Either
+// way, they stay clear of the next chunk's, as no more tokens start before
+// the chunk's end than there are bytes.
+static void move_tokens(tokens_res *res, size_t dest, size_t src, size_t amt) {
+  memmove(res->starts + dest, res->starts + src, amt * sizeof(buf_ind_t));
+  memmove(res->lens + dest, res->lens + src, amt * sizeof(token_len_t));
+  memmove(res->types + dest, res->types + src, amt * sizeof(token_type));
+  memmove(res->symbols + dest, res->symbols + src, amt * sizeof(symbol_id));
+}
+
+// Swaps the chunk's symbol IDs for the result's. Done in order, so that IDs
+// match the serial scanner's.
+static void remap_symbols(tokens_res *res, const symbol_table *local,
+                          size_t start, size_t amt) {
+  const u32 local_amt = symbol_amount(local);
+  symbol_id *remap = malloc(sizeof(symbol_id) * MAX(local_amt, 1));
+  for (u32 i = 0; i < local_amt; i++) {
+    remap[i] = SYMBOL_NONE;
+  }
+  for (size_t i = start; i < start + amt; i++) {
+    const symbol_id sym = res->symbols[i];
+    if (sym == SYMBOL_NONE) {
+      continue;
+    }
+    if (remap[sym] == SYMBOL_NONE) {
+      remap[sym] = intern_symbol(
+        res->symbol_table, symbol_name(local, sym), symbol_len(local, sym));
+    }
+    res->symbols[i] = remap[sym];
+  }
+  free(remap);
+}
+
+static void merge_chunks(tokens_res *res, source_file file, scan_chunk *chunks,
+                         unsigned chunk_amt) {
+  // What the serial scanner would produce next
+  token_res pending = scan(file, 0);
+  // Tokens the serial scanner produced before it lined up with a chunk
+  vec_token resynced = VEC_NEW;
+
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    const scan_chunk *chunk = &chunks[i];
+    const buf_ind_t *cstarts = res->starts + chunk->begin;
+    size_t j = 0;
+    bool synced = false;
+    VEC_CLEAR(&resynced);
+    while (pending.succeeded && pending.tok.type != TK_EOF &&
+           pending.tok.start < chunk->end) {
+      while (j < chunk->token_amt && cstarts[j] < pending.tok.start)
+        j++;
+      if (j < chunk->token_amt && cstarts[j] == pending.tok.start) {
+        // In sync, so the rest of the chunk is what we'd have produced
+        synced = true;
+        pending = chunk->last;
+        break;
+      }
+      VEC_PUSH(&resynced, pending.tok);
+      pending = scan(file, pending.tok.start + pending.tok.len);
+    }
+    // The chunk's tokens go after the resynced ones, and have to move before
+    // those are written, as they might be written over
+    const size_t chunk_at = res->token_amt + resynced.len;
+    const size_t moved_amt = synced ? chunk->token_amt - j : 0;
+    move_tokens(res, chunk_at, chunk->begin + j, moved_amt);
+    for (size_t k = 0; k < resynced.len; k++) {
+      push_token(res, file, VEC_GET(resynced, k));
+    }
+    remap_symbols(res, chunk->symbol_table, chunk_at, moved_amt);
+    res->token_amt += moved_amt;
+  }
+  VEC_FREE(&resynced);
+
+  if (pending.succeeded) {
+    debug_assert(pending.tok.type == TK_EOF);
+    push_token(res, file, pending.tok);
+  } else {
+    // the symbol table is left for free_tokens_res
+    free(res->symbols);
+    res->starts = NULL;
+    res->symbols = NULL;
+    res->lens = NULL;
+    res->types = NULL;
+    res->token_amt = 0;
+    res->succeeded = false;
+    res->error_pos = pending.tok.start;
+  }
+}
+
+static tokens_res scan_chunked(source_file file, size_t len,
+                               unsigned chunk_amt) {
+  // scan_all reports sources that are too long
+  if (chunk_amt <= 1 || len > SOURCE_LEN_MAX)
+    return scan_all_len(file, len);
+
+#ifdef TIME_TOKENIZER
+  perf_state perf_state = perf_start();
+#endif
+
+  tokens_res res = alloc_tokens_res(len + 1);
+  scan_chunk *chunks = malloc(sizeof(scan_chunk) * chunk_amt);
+  pthread_t *threads = malloc(sizeof(pthread_t) * chunk_amt);
+  bool *spawned = calloc(chunk_amt, sizeof(bool));
+
+  buf_ind_t begin = 0;
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    // the last chunk has to include EOF
+    buf_ind_t end = len + 1;
+    if (i + 1 < chunk_amt) {
+      buf_ind_t target = (uint64_t)len * (i + 1) / chunk_amt;
+      buf_ind_t limit = (uint64_t)len * (i + 2) / chunk_amt;
+      end = MAX(begin, find_cut(file.data, target, limit));
+    }
+    chunks[i] = (scan_chunk){
+      .file = file,
+      .begin = begin,
+      .end = end,
+      .res = &res,
+    };
+    begin = end;
+  }
+
+  // We scan the first chunk ourselves
+  for (unsigned i = 1; i < chunk_amt; i++) {
+    spawned[i] =
+      pthread_create(&threads[i], NULL, scan_chunk_worker, &chunks[i]) == 0;
+  }
+  scan_chunk_worker(&chunks[0]);
+  for (unsigned i = 1; i < chunk_amt; i++) {
+    if (spawned[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      scan_chunk_worker(&chunks[i]);
+    }
+  }
+
+  merge_chunks(&res, file, chunks, chunk_amt);
+
+  for (unsigned i = 0; i < chunk_amt; i++) {
+    symbol_table_free(chunks[i].symbol_table);
+  }
+  free(spawned);
+  free(threads);
+  free(chunks);
+
+#ifdef TIME_TOKENIZER
+  res.perf_values = perf_end(perf_state);
+#endif
+  return res;
+}
+
+tokens_res scan_all_chunked(source_file file, unsigned chunk_amt) {
+  return scan_chunked(file, strlen(file.data), chunk_amt);
+}
+
+tokens_res scan_all_parallel(source_file file) {
+  const size_t len = strlen(file.data);
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_chunks = len / MIN_CHUNK_BYTES;
+  unsigned chunk_amt = MIN((size_t)MAX(cores, 1), max_chunks);
+  return scan_chunked(file, len, chunk_amt);
+}
@@ -0,0 +1,245 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <string.h>
+
+#include "bitset.h"
+#include "hashers.h"
+#include "hashmap.h"
+#include "share_subtrees.h"
+#include "vec.h"
+
+// Integer literals and empty lists get their types from their context, and
+// type variables are scoped, so those can't be shared. Nor can anything that
+// contains them.
+static bool shareable_tag(parse_node_type_all tag) {
+  switch (tag) {
+    case PT_ALL_TY_CONSTRUCTION:
+    case PT_ALL_TY_CONSTRUCTOR_NAME:
+    case PT_ALL_TY_FN:
+    case PT_ALL_TY_LIST:
+    case PT_ALL_TY_TUP:
+    case PT_ALL_TY_UNIT:
+    case PT_ALL_EX_STRING:
+    case PT_ALL_EX_UNIT:
+    case PT_ALL_PAT_STRING:
+    case PT_ALL_PAT_UNIT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Children have to be shared before their parents, so that equal subtrees
+// have equal child indices.
+static bool cmp_parse_node_eq(const void *key_p, const void *stored_key,
+                              const void *ctx_p) {
+  const share_subtrees_ctx *ctx = ctx_p;
+  const parse_tree tree = *ctx->tree;
+  const node_ind_t a_ind = *((node_ind_t *)key_p);
+  const node_ind_t b_ind = *((node_ind_t *)stored_key);
+  const parse_node_type_all tag = PT_NODE_TAG(tree, a_ind);
+  if (tag != PT_NODE_TAG(tree, b_ind)) {
+    return false;
+  }
+  const parse_node_data a = PT_NODE_DATA(tree, a_ind);
+  const parse_node_data b = PT_NODE_DATA(tree, b_ind);
+  switch (tag) {
+    case PT_ALL_TY_CONSTRUCTOR_NAME:
+      return a.var_data.symbol == b.var_data.symbol &&
+             a.var_data.variable_index == b.var_data.variable_index;
+    case PT_ALL_EX_STRING:
+    case PT_ALL_PAT_STRING: {
+      const span a_span = PT_LEAF_SPAN(tree, a_ind);
+      const span b_span = PT_LEAF_SPAN(tree, b_ind);
+      return a_span.len == b_span.len &&
+             memcmp(ctx->input + a_span.start,
+                    ctx->input + b_span.start,
+                    a_span.len) == 0;
+    }
+    default:
+      break;
+  }
+  switch (pt_subs_type[tag]) {
+    case SUBS_NONE:
+      return true;
+    case SUBS_ONE:
+      return a.one_sub.ind == b.one_sub.ind;
+    case SUBS_TWO:
+      return a.two_subs.a == b.two_subs.a && a.two_subs.b == b.two_subs.b;
+    case SUBS_EXTERNAL:
+      return a.more_subs.amt == b.more_subs.amt &&
+             memcmp(&tree.inds[a.more_subs.start],
+                    &tree.inds[b.more_subs.start],
+                    sizeof(node_ind_t) * a.more_subs.amt) == 0;
+  }
+  return false;
+}
+
+// Points every reference to a copy at the first occurrence, and returns, for
+// each node, the node it's a copy of, or itself.
+static node_ind_t *find_copies(parse_tree *tree, const char *input) {
+  share_subtrees_ctx ctx = {
+    .tree = tree,
+    .input = input,
+  };
+  a_hashmap canonical = hashset_new(
+    node_ind_t, cmp_parse_node_eq, hash_parse_node, hash_parse_node);
+  node_ind_t *copy_of = malloc(sizeof(node_ind_t) * tree->node_amt);
+  for (node_ind_t i = 0; i < tree->node_amt; i++) {
+    copy_of[i] = i;
+  }
+  bitset shareable = bs_new_false_n(tree->node_amt);
+
+  // Post-order, so that children are shared before their parents. Children
+  // are visited in source order, so the first occurrence is the one we keep.
+  vec_node_ind stack = VEC_NEW;
+  // whether each stack entry's children have been pushed
+  bitset expanded = bs_new();
+  for (node_ind_t i = 0; i < tree->root_subs_amt; i++) {
+    VEC_PUSH(&stack,
+             tree->inds[tree->root_subs_start + tree->root_subs_amt - 1 - i]);
+    bs_push_false(&expanded);
+  }
+
+  while (stack.len > 0) {
+    const node_ind_t node = VEC_PEEK(stack);
+    node_ind_t sub_amt;
+    node_ind_t *subs = pt_node_subs(
+      PT_NODE_TAG(*tree, node), &tree->node_data[node], tree->inds, &sub_amt);
+    if (!bs_peek(&expanded)) {
+      bs_pop(&expanded);
+      bs_push_true(&expanded);
+      for (node_ind_t i = 0; i < sub_amt; i++) {
+        VEC_PUSH(&stack, subs[sub_amt - 1 - i]);
+        bs_push_false(&expanded);
+      }
+      continue;
+    }
+    VEC_POP_(&stack);
+    bs_pop(&expanded);
+
+    bool share = shareable_tag(PT_NODE_TAG(*tree, node));
+    for (node_ind_t i = 0; i < sub_amt; i++) {
+      subs[i] = copy_of[subs[i]];
+      share &= bs_get(shareable, subs[i]);
+    }
+    if (!share) {
+      continue;
+    }
+    const u32 bucket_ind = ahm_lookup(&canonical, &node, &ctx);
+    if (bs_get(canonical.occupied, bucket_ind)) {
+      copy_of[node] = ((node_ind_t *)canonical.keys)[bucket_ind];
+    } else {
+      ahm_insert_stored(&canonical, &node, NULL, &ctx);
+      bs_set(shareable, node);
+    }
+  }
+
+  VEC_FREE(&stack);
+  bs_free(&expanded);
+  bs_free(&shareable);
+  ahm_free(&canonical);
+  return copy_of;
+}
+
+share_subtrees_res share_subtrees(parse_tree *tree, const char *input) {
+  node_ind_t *copy_of = find_copies(tree, input);
+
+  // Nothing refers to copies any more, and copies' children are copies, so
+  // we can drop them all, and renumber what's left, keeping its order.
+  node_ind_t *renumbered = malloc(sizeof(node_ind_t) * tree->node_amt);
+  node_ind_t node_amt = 0;
+  node_ind_t ind_amt = tree->root_subs_amt;
+  for (node_ind_t i = 0; i < tree->node_amt; i++) {
+    if (copy_of[i] != i) {
+      continue;
+    }
+    renumbered[i] = node_amt++;
+    if (pt_subs_type[PT_NODE_TAG(*tree, i)] == SUBS_EXTERNAL) {
+      ind_amt += tree->node_data[i].more_subs.amt;
+    }
+  }
+
+  share_subtrees_res res = {
+    .nodes_removed = tree->node_amt - node_amt,
+    .inds_removed = tree->ind_amt - ind_amt,
+  };
+  res.bytes_saved =
+    (sizeof(parse_node_data) + sizeof(parse_node_phase_data) + sizeof(u8)) *
+      res.nodes_removed +
+    sizeof(node_ind_t) * res.inds_removed;
+
+  if (res.nodes_removed == 0) {
+    free(renumbered);
+    free(copy_of);
+    return res;
+  }
+
+  // one allocation, laid out like the parser's
+  size_t data_bytes = sizeof(parse_node_data) * node_amt;
+  size_t phase_data_bytes = sizeof(parse_node_phase_data) * node_amt;
+  size_t inds_bytes = sizeof(node_ind_t) * ind_amt;
+  size_t buf_bytes = data_bytes + phase_data_bytes + inds_bytes + node_amt;
+  char *buf = malloc(buf_bytes);
+  parse_node_data *node_data = (parse_node_data *)buf;
+  parse_node_phase_data *phase_data =
+    (parse_node_phase_data *)(buf + data_bytes);
+  node_ind_t *inds = (node_ind_t *)(buf + data_bytes + phase_data_bytes);
+  u8 *tags = (u8 *)(buf + data_bytes + phase_data_bytes + inds_bytes);
+
+  node_ind_t ind_pos = 0;
+  for (node_ind_t i = 0; i < tree->node_amt; i++) {
+    if (copy_of[i] != i) {
+      continue;
+    }
+    const node_ind_t j = renumbered[i];
+    parse_node_data data = tree->node_data[i];
+    switch (pt_subs_type[PT_NODE_TAG(*tree, i)]) {
+      case SUBS_NONE:
+        break;
+      case SUBS_ONE:
+        data.one_sub.ind = renumbered[data.one_sub.ind];
+        break;
+      case SUBS_TWO:
+        data.two_subs.a = renumbered[data.two_subs.a];
+        data.two_subs.b = renumbered[data.two_subs.b];
+        break;
+      case SUBS_EXTERNAL:
+        for (node_ind_t k = 0; k < data.more_subs.amt; k++) {
+          inds[ind_pos + k] = renumbered[tree->inds[data.more_subs.start + k]];
+        }
+        data.more_subs.start = ind_pos;
+        ind_pos += data.more_subs.amt;
+        break;
+    }
+    node_data[j] = data;
+    phase_data[j] = tree->phase_data[i];
+    tags[j] = tree->tags[i];
+  }
+  // the root's indices stay at the end
+  for (node_ind_t i = 0; i < tree->root_subs_amt; i++) {
+    inds[ind_pos + i] = renumbered[tree->inds[tree->root_subs_start + i]];
+  }
+
+  if (tree->mapped_bytes > 0) {
+    // The mapping owns the old arrays, and the new ones fit where they were
+    memcpy(tree->node_data, buf, buf_bytes);
+    free(buf);
+    buf = (char *)tree->node_data;
+  } else {
+    free(tree->node_data);
+  }
+  tree->node_data = (parse_node_data *)buf;
+  tree->phase_data = (parse_node_phase_data *)(buf + data_bytes);
+  tree->inds = (node_ind_t *)(buf + data_bytes + phase_data_bytes);
+  tree->tags = (u8 *)(buf + data_bytes + phase_data_bytes + inds_bytes);
+  tree->root_subs_start = ind_pos;
+  tree->node_amt = node_amt;
+  tree->ind_amt = ind_amt;
+
+  free(renumbered);
+  free(copy_of);
+  return res;
+}
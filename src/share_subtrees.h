@@ -0,0 +1,34 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+
+#include "parse_tree.h"
+
+typedef struct {
+  node_ind_t nodes_removed;
+  node_ind_t inds_removed;
+  // from the tree's node arrays and indices
+  size_t bytes_saved;
+} share_subtrees_res;
+
+// What the node hashers need to compare two nodes
+typedef struct {
+  const parse_tree *tree;
+  const char *input;
+} share_subtrees_ctx;
+
+// Hash-conses the subtrees that can't bind or refer to anything local: types
+// without type variables, string literals, and units. Every reference to a
+// copy is pointed at its first occurrence, and the copies are dropped, so the
+// tree stays dense, and per-node arrays stay keyed by node index.
+//
+// Call this after resolve_bindings, as constructor names are only equal if
+// they resolve to the same type. Shared nodes are visited once per reference.
+//
+// Spans of shared nodes, and of nodes that end in one, point into the first
+// occurrence, so diagnostics should come from an unshared tree.
+share_subtrees_res share_subtrees(parse_tree *tree, const char *input);
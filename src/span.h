@@ -9,7 +9,8 @@
 #include "consts.h"
 
 // sizeof: 8
-typedef struct {
+// Tagged, so that macros can build one where a variable is called `span`
+typedef struct span {
   buf_ind_t start;
   buf_ind_t len;
 } span;
@@ -24,46 +24,159 @@ static uint8_t char_to_base16_digit(char c) {
   return c - '0';
 }
 
+// UINT64_MAX has 20 digits, so any 19 digit number fits
+#define MAX_EXACT_BASE10_DIGITS 19
+#define MAX_BASE16_DIGITS 16
+
+#define EIGHT_ZEROS UINT64_C(0x3030303030303030)
+
+// Loads eight chars, the first in the lowest byte, whatever the endianness.
+// Compiles to a single load on little endian targets.
+static uint64_t load_eight_chars(const char *restrict str) {
+  const uint8_t *restrict s = (const uint8_t *)str;
+  return (uint64_t)s[0] | (uint64_t)s[1] << 8 | (uint64_t)s[2] << 16 |
+         (uint64_t)s[3] << 24 | (uint64_t)s[4] << 32 | (uint64_t)s[5] << 40 |
+         (uint64_t)s[6] << 48 | (uint64_t)s[7] << 56;
+}
+
+static const char *skip_leading_zeros(const char *restrict str,
+                                      size_t *restrict str_len) {
+  size_t len = *str_len;
+  while (len >= 8 && load_eight_chars(str) == EIGHT_ZEROS) {
+    str += 8;
+    len -= 8;
+  }
+  while (len > 0 && str[0] == '0') {
+    str++;
+    len--;
+  }
+  *str_len = len;
+  return str;
+}
+
+// SWAR: each step multiplies adjacent lanes together, halving the lane
+// count, and doubling their width.
+static uint32_t parse_eight_base10_digits(const char *restrict str) {
+  uint64_t val = load_eight_chars(str) - EIGHT_ZEROS;
+  val = (val * 10 + (val >> 8)) & UINT64_C(0x00ff00ff00ff00ff);
+  val = (val * 100 + (val >> 16)) & UINT64_C(0x0000ffff0000ffff);
+  return (uint32_t)(val * 10000 + (val >> 32));
+}
+
+// '0'-'9' have 0x3 in the high nibble, and letters have 0x4 or 0x6, so bit 6
+// tells us whether to add the 9 that gets 'a' (0x61) and 'A' (0x41) to 10.
+static uint32_t parse_eight_base16_digits(const char *restrict str) {
+  uint64_t val = load_eight_chars(str);
+  val = (val & UINT64_C(0x0f0f0f0f0f0f0f0f)) +
+        ((val >> 6) & UINT64_C(0x0101010101010101)) * 9;
+  val = ((val & UINT64_C(0x000f000f000f000f)) << 4) |
+        ((val >> 8) & UINT64_C(0x000f000f000f000f));
+  val = ((val & UINT64_C(0x000000ff000000ff)) << 8) |
+        ((val >> 16) & UINT64_C(0x000000ff000000ff));
+  return (uint32_t)(((val & 0xffff) << 16) | ((val >> 32) & 0xffff));
+}
+
+#if defined(__SSE4_1__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_SIXTEEN_DIGITS
+
+// Same idea as the SWAR version, with each multiply-add combining lanes
+static uint64_t parse_sixteen_base10_digits(const char *restrict str) {
+  __m128i val = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)str),
+                             _mm_set1_epi8('0'));
+  val = _mm_maddubs_epi16(
+    val,
+    _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+  val =
+    _mm_madd_epi16(val, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  val = _mm_packus_epi32(val, val);
+  val = _mm_madd_epi16(
+    val, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+  return (uint64_t)(uint32_t)_mm_cvtsi128_si32(val) * 100000000 +
+         (uint32_t)_mm_extract_epi32(val, 1);
+}
+
+static uint64_t parse_sixteen_base16_digits(const char *restrict str) {
+  const __m128i chars = _mm_loadu_si128((const __m128i *)str);
+  const __m128i letters = _mm_cmpgt_epi8(chars, _mm_set1_epi8('9'));
+  __m128i val =
+    _mm_add_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x0f)),
+                 _mm_and_si128(letters, _mm_set1_epi8(9)));
+  val = _mm_maddubs_epi16(
+    val,
+    _mm_setr_epi8(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1));
+  val =
+    _mm_madd_epi16(val, _mm_setr_epi16(256, 1, 256, 1, 256, 1, 256, 1));
+  val = _mm_packus_epi32(val, val);
+  // the most significant group comes first
+  val = _mm_shufflelo_epi16(val, _MM_SHUFFLE(0, 1, 2, 3));
+  return (uint64_t)_mm_cvtsi128_si64(val);
+}
+#endif
+
 // Can be optimized by removing the noinline, but it generates a lot of code.
 static HEDLEY_NEVER_INLINE uint64_t parse_arbitrary_positive_base10(
-  bool *restrict overflow, const char *restrict str, const size_t str_len,
+  bool *restrict overflow, const char *restrict str, size_t str_len,
   uint64_t maximum) {
+  str = skip_leading_zeros(str, &str_len);
+  if (str_len > MAX_EXACT_BASE10_DIGITS + 1) {
+    *overflow = true;
+    return 0;
+  }
+  const size_t exact_len = MIN(str_len, MAX_EXACT_BASE10_DIGITS);
   uint64_t res = 0;
-  uint64_t limit = maximum / 10;
-  for (size_t i = 0; i < str_len; i++) {
-    if (res > limit) {
-      *overflow = true;
-      return res;
-    }
-    res *= 10;
-    uint64_t digit = str[i] - '0';
-    if (res > maximum - digit) {
+  size_t i = 0;
+#ifdef HAVE_SIXTEEN_DIGITS
+  if (exact_len >= 16) {
+    res = parse_sixteen_base10_digits(str);
+    i = 16;
+  }
+#endif
+  for (; exact_len - i >= 8; i += 8) {
+    res = res * 100000000 + parse_eight_base10_digits(str + i);
+  }
+  for (; i < exact_len; i++) {
+    res = res * 10 + (uint64_t)(str[i] - '0');
+  }
+  if (str_len > MAX_EXACT_BASE10_DIGITS) {
+    uint64_t digit = str[MAX_EXACT_BASE10_DIGITS] - '0';
+    if (res > (UINT64_MAX - digit) / 10) {
       *overflow = true;
       return res;
     }
-    res += digit;
+    res = res * 10 + digit;
+  }
+  if (res > maximum) {
+    *overflow = true;
   }
   return res;
 }
 
 // Can be optimized by removing the noinline, but it generates a lot of code.
 static HEDLEY_NEVER_INLINE uint64_t parse_arbitrary_positive_base16(
-  bool *restrict overflow, const char *restrict str, const size_t str_len,
+  bool *restrict overflow, const char *restrict str, size_t str_len,
   uint64_t maximum) {
+  str = skip_leading_zeros(str, &str_len);
+  if (str_len > MAX_BASE16_DIGITS) {
+    *overflow = true;
+    return 0;
+  }
   uint64_t res = 0;
-  uint64_t limit = maximum / 16;
-  for (size_t i = 0; i < str_len; i++) {
-    if (res > limit) {
-      *overflow = true;
-      return res;
-    }
-    res *= 16;
-    uint64_t digit = char_to_base16_digit(str[i]);
-    if (res > maximum - digit) {
-      *overflow = true;
-      return res;
-    }
-    res += digit;
+  size_t i = 0;
+#ifdef HAVE_SIXTEEN_DIGITS
+  if (str_len == 16) {
+    res = parse_sixteen_base16_digits(str);
+    i = 16;
+  }
+#endif
+  for (; str_len - i >= 8; i += 8) {
+    res = res << 32 | parse_eight_base16_digits(str + i);
+  }
+  for (; i < str_len; i++) {
+    res = res << 4 | char_to_base16_digit(str[i]);
+  }
+  if (res > maximum) {
+    *overflow = true;
   }
   return res;
 }
@@ -88,7 +201,7 @@ static HEDLEY_NEVER_INLINE uint64_t parse_arbitrary(
   *negative_p = negative;
   bool overflow = false;
   uint64_t res = 0;
-  size_t limit = negative ? 0 - minimum : maximum;
+  uint64_t limit = negative ? 0 - (uint64_t)minimum : (uint64_t)maximum;
   switch (base) {
     case BASE_10:
       res = parse_arbitrary_positive_base10(&overflow, str, str_len, limit);
@@ -0,0 +1,69 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashers.h"
+#include "hashmap.h"
+#include "symbol_table.h"
+#include "vec.h"
+
+static bool cmp_symbol(const void *key_p, const void *sym_p,
+                       const void *ctx_p) {
+  const symbol_key key = *((symbol_key *)key_p);
+  const symbol_id sym = *((symbol_id *)sym_p);
+  const symbol_table *table = (symbol_table *)ctx_p;
+  return symbol_len(table, sym) == key.len &&
+         memcmp(symbol_name(table, sym), key.str, key.len) == 0;
+}
+
+symbol_table *symbol_table_new(void) {
+  const symbol_table table = {
+    .map = hashset_new(symbol_id, cmp_symbol, hash_symbol, hash_stored_symbol),
+    .chars = VEC_NEW,
+    .starts = VEC_NEW,
+  };
+  symbol_table *res = malloc(sizeof(symbol_table));
+  memcpy(res, &table, sizeof(symbol_table));
+  VEC_PUSH(&res->starts, (u32)0);
+  return res;
+}
+
+symbol_id intern_symbol(symbol_table *table, const char *str, u32 len) {
+  symbol_key key = {
+    .str = str,
+    .len = len,
+  };
+  ahm_maybe_rehash(&table->map, table);
+  u32 bucket_ind = ahm_lookup(&table->map, &key, table);
+  if (bs_get(table->map.occupied, bucket_ind)) {
+    return ((symbol_id *)table->map.keys)[bucket_ind];
+  }
+  symbol_id sym = symbol_amount(table);
+  VEC_APPEND(&table->chars, len, str);
+  VEC_PUSH(&table->starts, table->chars.len);
+  ahm_insert_at(&table->map, bucket_ind, &sym, NULL);
+  return sym;
+}
+
+u32 symbol_amount(const symbol_table *table) { return table->starts.len - 1; }
+
+const char *symbol_name(const symbol_table *table, symbol_id sym) {
+  return VEC_DATA_PTR(&table->chars) + VEC_GET(table->starts, sym);
+}
+
+u32 symbol_len(const symbol_table *table, symbol_id sym) {
+  return VEC_GET(table->starts, sym + 1) - VEC_GET(table->starts, sym);
+}
+
+void symbol_table_free(symbol_table *table) {
+  if (table == NULL) {
+    return;
+  }
+  ahm_free(&table->map);
+  VEC_FREE(&table->chars);
+  VEC_FREE(&table->starts);
+  free(table);
+}
@@ -0,0 +1,55 @@
+// Copyright 2023 The piq Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+
+#include "hashmap.h"
+#include "typedefs.h"
+#include "vec.h"
+
+// Dense, starting from zero, in order of first appearance
+#ifdef NARROW_INDICES
+// Names are separated by at least a byte, so a 64KiB source has fewer than
+// 32K of them. This brings a name node's data down to four bytes.
+typedef u16 symbol_id;
+#else
+typedef u32 symbol_id;
+#endif
+
+VEC_DECL(symbol_id);
+
+// For tokens that aren't names
+#ifdef NARROW_INDICES
+#define SYMBOL_NONE UINT16_MAX
+#else
+#define SYMBOL_NONE UINT32_MAX
+#endif
+
+// Interns identifier spellings, so that later phases can compare and hash
+// symbol IDs, instead of strings.
+typedef struct {
+  // stores symbol IDs, keyed by spelling
+  a_hashmap map;
+  // spellings, back to back
+  vec_char chars;
+  // where each symbol's spelling starts in `chars`, plus one for the end
+  vec_u32 starts;
+} symbol_table;
+
+// What we look spellings up by
+typedef struct {
+  const char *str;
+  u32 len;
+} symbol_key;
+
+// Heap allocated, as the hashmap can't be assigned
+symbol_table *symbol_table_new(void);
+symbol_id intern_symbol(symbol_table *table, const char *str, u32 len);
+u32 symbol_amount(const symbol_table *table);
+// Not NUL terminated. Invalidated by interning.
+const char *symbol_name(const symbol_table *table, symbol_id sym);
+u32 symbol_len(const symbol_table *table, symbol_id sym);
+void symbol_table_free(symbol_table *table);
@@ -128,15 +128,29 @@ test_state test_state_new(test_config config) {
     .total_bytes_tokenized = 0,
     .total_tokenization_perf = perf_zero,
     .total_tokens_produced = 0,
+    .total_rescan_perf = perf_zero,
+    .total_rescans = 0,
+    .total_int_literal_perf = perf_zero,
+    .total_int_literals_parsed = 0,
+    .total_int_literal_bytes = 0,
 #endif
 #ifdef TIME_PARSER
     .total_parser_perf = perf_zero,
     .total_tokens_parsed = 0,
     .total_parse_nodes_produced = 0,
+    .total_parse_tree_stats = {0},
+    .total_lemon_driver_perf = perf_zero,
+    .total_lemon_driver_tokens = 0,
+    .total_table_driver_perf = perf_zero,
+    .total_table_driver_tokens = 0,
 #endif
 #ifdef TIME_NAME_RESOLUTION
     .total_name_resolution_perf = perf_zero,
     .total_names_looked_up = 0,
+    .total_hashed_resolver_perf = perf_zero,
+    .total_hashed_resolver_names = 0,
+    .total_symbol_resolver_perf = perf_zero,
+    .total_symbol_resolver_names = 0,
 #endif
 #ifdef TIME_TYPECHECK
     .total_typecheck_perf = perf_zero,
@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include "defs.h"
+#include "parse_tree_stats.h"
 #include "timing.h"
 #include "token.h"
 #include "vec.h"
@@ -79,15 +80,29 @@ typedef struct {
   uint64_t total_bytes_tokenized;
   perf_values total_tokenization_perf;
   uint64_t total_tokens_produced;
+  perf_values total_rescan_perf;
+  uint64_t total_rescans;
+  perf_values total_int_literal_perf;
+  uint64_t total_int_literals_parsed;
+  uint64_t total_int_literal_bytes;
 #endif
 #ifdef TIME_PARSER
   perf_values total_parser_perf;
   uint64_t total_tokens_parsed;
   uint64_t total_parse_nodes_produced;
+  parse_tree_stats total_parse_tree_stats;
+  perf_values total_lemon_driver_perf;
+  uint64_t total_lemon_driver_tokens;
+  perf_values total_table_driver_perf;
+  uint64_t total_table_driver_tokens;
 #endif
 #ifdef TIME_NAME_RESOLUTION
   perf_values total_name_resolution_perf;
   uint64_t total_names_looked_up;
+  perf_values total_hashed_resolver_perf;
+  uint64_t total_hashed_resolver_names;
+  perf_values total_symbol_resolver_perf;
+  uint64_t total_symbol_resolver_names;
 #endif
 #ifdef TIME_TYPECHECK
   perf_values total_typecheck_perf;
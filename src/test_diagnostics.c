@@ -2,7 +2,10 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <string.h>
+
 #include "diagnostic.h"
+#include "line_index.h"
 #include "test.h"
 #include "util.h"
 
@@ -12,14 +15,71 @@ const char *test_program = "(sig sndpar (Fn (I16, I32) I32))\n"
                            "(sig (Fn () I32))\n"
                            "(fun test () (sndpar (1, 2)))";
 
+static void test_line_index(test_state *state) {
+  test_group_start(state, "Line index");
+
+  test_start(state, "Positions");
+  {
+    line_index lines = build_line_index(test_program);
+    test_assert_eq(state, lines.line_amt, 5);
+    test_assert_eq(state, lines.len, strlen(test_program));
+    position_info pos = find_line_and_col(&lines, 0);
+    test_assert_eq(state, pos.line, 1);
+    test_assert_eq(state, pos.column, 1);
+    // the newline belongs to the line it ends
+    pos = find_line_and_col(&lines, 32);
+    test_assert_eq(state, pos.line, 1);
+    test_assert_eq(state, pos.column, 33);
+    pos = find_line_and_col(&lines, 33);
+    test_assert_eq(state, pos.line, 2);
+    test_assert_eq(state, pos.column, 1);
+    pos = find_line_and_col(&lines, 55);
+    test_assert_eq(state, pos.line, 3);
+    test_assert_eq(state, pos.column, 1);
+    pos = find_line_and_col(&lines, lines.len);
+    test_assert_eq(state, pos.line, 5);
+    test_assert_eq(state, pos.column, 30);
+    free_line_index(lines);
+  }
+  test_end(state);
+
+  test_start(state, "Long lines");
+  {
+    // newlines on both sides of SIMD chunk boundaries
+    char input[200];
+    memset(input, 'a', sizeof(input) - 1);
+    input[sizeof(input) - 1] = '\0';
+    const buf_ind_t newlines[] = {0, 15, 16, 31, 32, 33, 100, 197, 198};
+    for (size_t i = 0; i < STATIC_LEN(newlines); i++) {
+      input[newlines[i]] = '\n';
+    }
+    line_index lines = build_line_index(input);
+    test_assert_eq(state, lines.line_amt, STATIC_LEN(newlines) + 1);
+    for (size_t i = 0; i < STATIC_LEN(newlines); i++) {
+      test_assert_eq(state, lines.line_starts[i + 1], newlines[i] + 1);
+    }
+    position_info pos = find_line_and_col(&lines, 150);
+    test_assert_eq(state, pos.line, 8);
+    test_assert_eq(state, pos.column, 50);
+    free_line_index(lines);
+  }
+  test_end(state);
+
+  test_group_end(state);
+}
+
 void test_diagnostics(test_state *state) {
+  test_line_index(state);
+
   test_group_start(state, "Robustness");
 
   test_start(state, "previous context");
   {
     stringstream output;
     ss_init_immovable(&output);
-    format_error_ctx(output.stream, test_program, 0, 1);
+    line_index lines = build_line_index(test_program);
+    format_error_ctx(output.stream, &lines, 0, 1);
+    free_line_index(lines);
     ss_finalize(&output);
     size_t newlines = count_char_occurences(output.string, '\n');
     test_assert_eq(state, newlines, 4);
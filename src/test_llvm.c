@@ -253,6 +253,16 @@ void test_llvm(test_state *state) {
   }
   test_end(state);
 
+  test_start(state, "Can build and destructure tuples");
+  {
+    const char *input = "(sig (Fn (I32, I32, I32) I32))\n"
+                        "(fun pick ((a, b, c)) b)\n"
+                        "(sig (Fn I32))\n"
+                        "(fun test () (pick (1, 2, 3)))";
+    test_llvm_code_produces_int(state, input, 2);
+  }
+  test_end(state);
+
   test_start(state, "If expressions work");
   {
     const char *input = "(sig (Fn I32))\n"
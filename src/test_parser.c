@@ -3,12 +3,17 @@
 // license that can be found in the LICENSE file.
 
 #include <alloca.h>
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "ast_cache.h"
 #include "bitset.h"
 #include "defs.h"
 #include "diagnostic.h"
+#include "input_stream.h"
 #include "parse_tree.h"
+#include "parse_tree_stats.h"
 #include "parser.h"
 #include "test.h"
 #include "test_upto.h"
@@ -26,9 +31,135 @@ typedef struct {
   char *str;
 } expected_output;
 
+static bool parse_nodes_identical(parse_tree ta, parse_tree tb,
+                                  node_ind_t i) {
+  parse_node a = PT_NODE(ta, i);
+  parse_node b = PT_NODE(tb, i);
+  if (a.type.all != b.type.all ||
+      PT_NODE_FIRST_TOKEN(ta, i) != PT_NODE_FIRST_TOKEN(tb, i)) {
+    return false;
+  }
+  switch (pt_subs_type[a.type.all]) {
+    case SUBS_NONE:
+      return a.data.var_data.symbol == b.data.var_data.symbol;
+    case SUBS_ONE:
+      return a.data.one_sub.ind == b.data.one_sub.ind;
+    case SUBS_TWO:
+      return a.data.two_subs.a == b.data.two_subs.a &&
+             a.data.two_subs.b == b.data.two_subs.b;
+    case SUBS_EXTERNAL:
+      return a.data.more_subs.start == b.data.more_subs.start &&
+             a.data.more_subs.amt == b.data.more_subs.amt;
+  }
+  return false;
+}
+
+// Same nodes, indices, and tokens, in the same places, so the same spans
+static bool parse_trees_identical(parse_tree a, parse_tree b) {
+  if (a.node_amt != b.node_amt || a.ind_amt != b.ind_amt ||
+      a.root_subs_start != b.root_subs_start ||
+      a.root_subs_amt != b.root_subs_amt || a.token_amt != b.token_amt ||
+      a.max_depth != b.max_depth) {
+    return false;
+  }
+  for (node_ind_t i = 0; i < a.node_amt; i++) {
+    if (!parse_nodes_identical(a, b, i)) {
+      return false;
+    }
+  }
+  return memcmp(a.inds, b.inds, sizeof(node_ind_t) * a.ind_amt) == 0 &&
+         memcmp(a.token_starts,
+                b.token_starts,
+                sizeof(buf_ind_t) * a.token_amt) == 0 &&
+         memcmp(a.token_lens,
+                b.token_lens,
+                sizeof(token_len_t) * a.token_amt) == 0;
+}
+
+// The streaming pipeline should agree with the two-pass one
+static void test_streaming_parser_matches(test_state *state,
+                                          const char *restrict input,
+                                          parse_tree_res pres) {
+  source_file file = {.path = "parser-test", .data = input};
+  tokens_res tres;
+  parse_tree_res spres = scan_and_parse(file, &tres);
+  test_assert(state, tres.succeeded);
+  test_assert_eq(state, spres.success, pres.success);
+  if (spres.success && pres.success) {
+    char *a = print_parse_tree_str(input, pres.tree);
+    char *b = print_parse_tree_str(input, spres.tree);
+    if (strcmp(a, b) != 0) {
+      failf(state,
+            "Streaming parse tree differs.\n"
+            "Two-pass:  '%s'\n"
+            "Streaming: '%s'",
+            a,
+            b);
+    }
+    free(a);
+    free(b);
+    // names' symbols don't show up in the printed tree
+    if (!parse_trees_identical(pres.tree, spres.tree)) {
+      failf(state, "Streaming parse tree's nodes or tokens differ.");
+    }
+  } else if (!spres.success && !pres.success) {
+    test_assert_eq(state, spres.errors.error_pos, pres.errors.error_pos);
+    test_assert(
+      state, spans_equal(spres.errors.error_span, pres.errors.error_span));
+  }
+  free_parse_tree_res(spres);
+  free_tokens_res(tres);
+}
+
+// Parsing top-level forms in parallel should give exactly the serial result
+static void test_parallel_parser_matches(test_state *state,
+                                         const char *restrict input,
+                                         parse_tree_res pres) {
+  source_file file = {.path = "parser-test", .data = input};
+  tokens_res tres = scan_all(file);
+  if (!tres.succeeded) {
+    free_tokens_res(tres);
+    return;
+  }
+  static const unsigned chunk_amts[] = {2, 3, 8};
+  for (size_t i = 0; i < STATIC_LEN(chunk_amts); i++) {
+    parse_tree_res cpres = parse_chunked(tres, chunk_amts[i]);
+    test_assert_eq(state, cpres.success, pres.success);
+    if (cpres.success && pres.success) {
+      if (!parse_trees_identical(pres.tree, cpres.tree)) {
+        char *a = print_parse_tree_str(input, pres.tree);
+        char *b = print_parse_tree_str(input, cpres.tree);
+        failf(state,
+              "Parse tree from %u chunks differs.\n"
+              "Serial:  '%s'\n"
+              "Chunked: '%s'",
+              chunk_amts[i],
+              a,
+              b);
+        free(a);
+        free(b);
+      }
+    } else if (!cpres.success && !pres.success) {
+      test_assert_eq(state, cpres.errors.error_pos, pres.errors.error_pos);
+      test_assert(
+        state, spans_equal(cpres.errors.error_span, pres.errors.error_span));
+      test_assert(state,
+                  multiset_eq(sizeof(token_type),
+                              cpres.errors.expected_amt,
+                              pres.errors.expected_amt,
+                              cpres.errors.expected,
+                              pres.errors.expected));
+    }
+    free_parse_tree_res(cpres);
+  }
+  free_tokens_res(tres);
+}
+
 static void test_parser_succeeds_on(test_state *state, const char *input,
                                     expected_output output) {
   parse_tree_res pres = test_upto_parse_tree(state, input);
+  test_streaming_parser_matches(state, input, pres);
+  test_parallel_parser_matches(state, input, pres);
   if (pres.success) {
     switch (output.tag) {
       case ANY:
@@ -78,12 +209,16 @@ static void test_parser_fails_on(test_state *state, char *input, buf_ind_t pos,
                                  const token_type *expected) {
 
   tokens_res tres = test_upto_tokens(state, input);
-  if (!tres.succeeded)
+  if (!tres.succeeded) {
+    free_tokens_res(tres);
     return;
+  }
 
-  parse_tree_res pres = parse(tres.tokens, tres.token_amt);
+  parse_tree_res pres = parse(tres);
 
   add_parser_timings(state, tres, pres);
+  test_streaming_parser_matches(state, input, pres);
+  test_parallel_parser_matches(state, input, pres);
 
   if (pres.success) {
     char *parse_tree_str = print_parse_tree_str(input, pres.tree);
@@ -91,8 +226,7 @@ static void test_parser_fails_on(test_state *state, char *input, buf_ind_t pos,
           "Parsing \"%s\" was supposed to fail.\nGot parse tree:\n%s",
           input,
           parse_tree_str);
-    free((void *)pres.tree.inds);
-    free((void *)pres.tree.nodes);
+    free_parse_tree(pres.tree);
     goto end_a;
   }
 
@@ -126,7 +260,7 @@ static void test_parser_fails_on(test_state *state, char *input, buf_ind_t pos,
 
   free(pres.errors.expected);
 end_a:
-  free(tres.tokens);
+  free_tokens_res(tres);
 }
 
 static void test_parser_fails_on_form(test_state *state, char *input,
@@ -183,7 +317,12 @@ static void test_parser_robustness(test_state *state) {
     test_start(state, "Nested calls");
     stringstream in;
     ss_init_immovable(&in);
+#ifdef NARROW_INDICES
+    // as much as fits in 64KiB
+    static const size_t depth = 5000;
+#else
     static const size_t depth = 100000;
+#endif
     for (size_t i = 0; i < depth; i++) {
       fputs("(add (1, ", in.stream);
     }
@@ -413,6 +552,16 @@ static void test_parser_succeeds_compound(test_state *state) {
     test_end(state);
   }
 
+  {
+    test_start(state, "Nested tuple");
+    test_parser_succeeds_on_form(
+      state,
+      "(1, (2, 3), 4)",
+      expect_string("((IntExpression 1), ((IntExpression 2), (IntExpression "
+                    "3)), (IntExpression 4))"));
+    test_end(state);
+  }
+
   {
     test_start(state, "Typed");
     test_parser_succeeds_on_form(
@@ -685,10 +834,446 @@ static void test_parser_fails(test_state *state) {
   test_group_end(state);
 }
 
+typedef struct {
+  int fd;
+  const char *input;
+} pipe_writer_args;
+
+// Dribbles the input out in small writes, so that the parser has to keep
+// waiting for more
+static void *pipe_writer(void *arg) {
+  pipe_writer_args *args = arg;
+  size_t len = strlen(args->input);
+  for (size_t i = 0; i < len; i += 7) {
+    if (write(args->fd, args->input + i, MIN(7, len - i)) < 0)
+      break;
+  }
+  close(args->fd);
+  return NULL;
+}
+
+static void test_parser_streams_from_pipe(test_state *state,
+                                          const char *input) {
+  int fds[2];
+  input_stream stream;
+  if (pipe(fds) != 0 || !input_stream_start(&stream, fds[0])) {
+    failf(state, "Couldn't set up input stream");
+    return;
+  }
+  pipe_writer_args args = {.fd = fds[1], .input = input};
+  pthread_t writer;
+  pthread_create(&writer, NULL, pipe_writer, &args);
+
+  tokens_res stres;
+  parse_tree_res spres = scan_and_parse_stream(&stream, &stres);
+  const char *data = input_stream_finish(&stream);
+  pthread_join(writer, NULL);
+  close(fds[0]);
+
+  test_assert(state, data != NULL && strcmp(data, input) == 0);
+  test_assert(state, stres.succeeded);
+  test_assert(state, spres.success);
+  test_streaming_parser_matches(state, input, spres);
+
+  free_parse_tree_res(spres);
+  free_tokens_res(stres);
+  input_stream_free(&stream);
+}
+
+static void test_parser_streams_input(test_state *state) {
+  test_group_start(state, "Streaming input");
+
+  {
+    test_start(state, "From a pipe");
+    test_parser_streams_from_pipe(
+      state,
+      "(sig (Fn I32 I32))\n"
+      "(fun a (b)\n"
+      "  (if b 1 2))\n"
+      "(sig (Fn I32 (I32, I32)))\n"
+      "(fun c (d)\n"
+      "  (d, \"a string, with ( parens\"))\n"
+      "(data Pair [a b] (Pair I32 I32))\n"
+      "(sig (Fn I32 [I32]))\n"
+      "(fun e (f) [f, f, f, f, f, f, f, f, f, f, f, f])\n");
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+static void test_parallel_parser_matches_on(test_state *state,
+                                            const char *input) {
+  tokens_res tres = test_upto_tokens(state, input);
+  if (!tres.succeeded) {
+    free_tokens_res(tres);
+    return;
+  }
+  parse_tree_res pres = parse(tres);
+  test_parallel_parser_matches(state, input, pres);
+  free_parse_tree_res(pres);
+  free_tokens_res(tres);
+}
+
+static const char *parallel_forms = "#abi-c\n"
+                                    "(sig (Fn I32 I32))\n"
+                                    "(fun a (b)\n"
+                                    "  (if b 1 2))\n"
+                                    "(data Pair [a b] (Pair I32 I32))\n"
+                                    "(data Unit () (Unit))\n"
+                                    "(sig (Fn I32 (I32, I32, [I32])))\n"
+                                    "(fun c (d)\n"
+                                    "  (let e [d, d])\n"
+                                    "  (d, (fn ([f, g] (Just h)) f), e))\n"
+                                    "#abi-c\n"
+                                    "(sig (Fn [Maybe I32] ()))\n"
+                                    "(fun i (j) ())\n"
+                                    "(fun k () (as I32 (i 1)))\n";
+
+static void test_parser_parallel(test_state *state) {
+  test_group_start(state, "Parallel");
+
+  {
+    test_start(state, "Matches serial");
+    expected_output out = {.tag = ANY};
+    test_parser_succeeds_on(state, parallel_forms, out);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Error in a later form");
+    test_parallel_parser_matches_on(state,
+                                    "(sig (Fn I32 I32))\n"
+                                    "(fun a (b) b)\n"
+                                    "(fun c (d) (if d))\n"
+                                    "(fun e (f) f)\n");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Unbalanced");
+    test_parallel_parser_matches_on(state,
+                                    "(fun a (b) b))\n"
+                                    "(fun c (d) d)\n"
+                                    "(fun e (f) (f)\n");
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+// Each node's span, in node order
+static void test_parser_spans_on(test_state *state, const char *input,
+                                 const char **expected, node_ind_t amt) {
+  parse_tree_res pres = test_upto_parse_tree(state, input);
+  if (pres.success) {
+    test_assert_eq(state, pres.tree.node_amt, amt);
+    for (node_ind_t i = 0; i < MIN(pres.tree.node_amt, amt); i++) {
+      span span = pt_node_span(&pres.tree, i);
+      if (strlen(expected[i]) != span.len ||
+          strncmp(expected[i], input + span.start, span.len) != 0) {
+        failf(state,
+              "Wrong span for node %u.\n"
+              "Expected: '%s'\n"
+              "Got:      '%.*s'",
+              i,
+              expected[i],
+              span.len,
+              input + span.start);
+      }
+    }
+  }
+  free_parse_tree_res(pres);
+}
+
+static void test_parser_spans(test_state *state) {
+  test_group_start(state, "Spans");
+
+  {
+    test_start(state, "Expressions");
+    static const char *expected[] = {
+      "(fun f (a) [(a, b, c), []])",
+      "f",
+      "a",
+      "[(a, b, c), []]",
+      "[(a, b, c), []]",
+      "(a, b, c)",
+      "a",
+      "b",
+      "c",
+      "[]",
+    };
+    test_parser_spans_on(state,
+                         "(fun f (a) [(a, b, c), []])",
+                         expected,
+                         STATIC_LEN(expected));
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Types");
+    static const char *expected[] = {
+      "(sig (Fn [Fn A B] [Maybe A] ()))",
+      "(Fn [Fn A B] [Maybe A] ())",
+      "[Fn A B]",
+      "A",
+      "B",
+      "Fn A B",
+      "[Maybe A]",
+      "Maybe",
+      "A",
+      "Maybe A",
+      "()",
+    };
+    test_parser_spans_on(state,
+                         "(sig (Fn [Fn A B] [Maybe A] ()))",
+                         expected,
+                         STATIC_LEN(expected));
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Data declaration");
+    static const char *expected[] = {
+      "(data T [a] (C A) (D))",
+      "T",
+      "[a]",
+      "a",
+      "(C A) (D)",
+      "(C A)",
+      "C",
+      "A",
+      "(D)",
+      "D",
+    };
+    test_parser_spans_on(state,
+                         "(data T [a] (C A) (D))",
+                         expected,
+                         STATIC_LEN(expected));
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+// A cache should map back in as exactly the tree that was written, and only
+// for the source it was written for
+static void test_parser_ast_cache(test_state *state) {
+  test_group_start(state, "AST cache");
+  // Unique, so that concurrent runs don't trample each other's caches
+  char path[] = "/tmp/piq-test-XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    test_start(state, "Temp file");
+    failf(state, "Couldn't create a temp file for the AST cache");
+    test_end(state);
+    test_group_end(state);
+    return;
+  }
+  close(fd);
+  const char *input = "(sig (Fn I32 [U8]))\n"
+                      "(fun f (a) (let b (a, \"c\")) [])\n"
+                      "(data T [a] (C A) (D))";
+
+  {
+    test_start(state, "Round trip");
+    parse_tree_res pres = test_upto_parse_tree(state, input);
+    if (pres.success) {
+      test_assert(state, write_ast_cache(path, input, pres.tree));
+      ast_cache_stats before = get_ast_cache_stats();
+      parse_tree tree;
+      if (load_ast_cache(path, input, &tree)) {
+        test_assert(state, parse_trees_identical(pres.tree, tree));
+        test_assert(state, tree.mapped_bytes > 0);
+        free_parse_tree(tree);
+      } else {
+        failf(state, "Couldn't load the AST cache");
+      }
+      test_assert_eq(state, get_ast_cache_stats().hits, before.hits + 1);
+    }
+    free_parse_tree_res(pres);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Changed source");
+    const char *changed = "(sig (Fn I32 [U8]))\n"
+                          "(fun f (a) (let b (a, \"d\")) [])\n"
+                          "(data T [a] (C A) (D))";
+    ast_cache_stats before = get_ast_cache_stats();
+    parse_tree tree;
+    test_assert(state, !load_ast_cache(path, changed, &tree));
+    test_assert_eq(state, get_ast_cache_stats().misses, before.misses + 1);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Corrupt");
+    // As if another write had landed in the middle of the nodes
+    FILE *f = fopen(path, "r+b");
+    if (f != NULL) {
+      const int c = fgetc(f);
+      fseek(f, 0, SEEK_SET);
+      fputc(c ^ 0xff, f);
+      fclose(f);
+      parse_tree tree;
+      test_assert(state, !load_ast_cache(path, input, &tree));
+    } else {
+      failf(state, "Couldn't open the AST cache");
+    }
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Missing");
+    remove(path);
+    parse_tree tree;
+    test_assert(state, !load_ast_cache(path, input, &tree));
+    test_end(state);
+  }
+
+  // In case "Missing" was filtered out
+  remove(path);
+  test_group_end(state);
+}
+
+// The parser's max_depth, worked out the slow way
+static node_ind_t subtree_max_depth(parse_tree tree, node_ind_t node) {
+  node_ind_t amt;
+  const node_ind_t *subs = pt_node_subs(
+    PT_NODE_TAG(tree, node), &tree.node_data[node], tree.inds, &amt);
+  node_ind_t res = 0;
+  for (node_ind_t i = 0; i < amt; i++) {
+    res = MAX(res, amt - 1 - i + subtree_max_depth(tree, subs[i]));
+  }
+  return res + 1;
+}
+
+static void test_max_depth_on(test_state *state, const char *input,
+                              node_ind_t expected) {
+  parse_tree_res pres = test_upto_parse_tree(state, input);
+  if (pres.success) {
+    parse_tree tree = pres.tree;
+    node_ind_t slow = 0;
+    for (node_ind_t i = 0; i < tree.root_subs_amt; i++) {
+      const node_ind_t root = tree.inds[tree.root_subs_start + i];
+      slow = MAX(slow,
+                 tree.root_subs_amt - 1 - i + subtree_max_depth(tree, root));
+    }
+    test_assert_eq(state, tree.max_depth, slow);
+    if (expected > 0) {
+      test_assert_eq(state, tree.max_depth, expected);
+    }
+  }
+  free_parse_tree_res(pres);
+}
+
+static void test_parser_max_depth(test_state *state) {
+  test_group_start(state, "Max depth");
+
+  {
+    test_start(state, "Empty");
+    test_max_depth_on(state, "", 0);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Leaf");
+    test_max_depth_on(state, "(sig I32)", 2);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Later roots wait");
+    test_max_depth_on(state, "(sig I32)\n(sig I32)", 3);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Tuples");
+    test_max_depth_on(state, "(sig (I32, (I32, I32, I32), I32, I32))", 0);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Mixed forms");
+    test_max_depth_on(state, parallel_forms, 0);
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+static void test_parser_stats(test_state *state) {
+  test_group_start(state, "Stats");
+
+  {
+    test_start(state, "Empty");
+    parse_tree_res pres = test_upto_parse_tree(state, "");
+    if (pres.success) {
+      parse_tree_stats stats = {0};
+      parse_tree_stats_add(&stats, pres.tree);
+      test_assert_eq(state, stats.node_amt, 0);
+      test_assert_eq(state, stats.max_depth, 0);
+      test_assert_eq(state, parse_tree_stats_mean_depth(&stats), 0);
+    }
+    free_parse_tree_res(pres);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Tuples");
+    parse_tree_res pres =
+      test_upto_parse_tree(state, "(sig (I32, (I32, I32, I32)))");
+    if (pres.success) {
+      parse_tree_stats stats = {0};
+      parse_tree_stats_add(&stats, pres.tree);
+      test_assert_eq(state, stats.node_amt, 7);
+      test_assert_eq(state, stats.nodes_walked, 7);
+      test_assert_eq(state, stats.nodes_by_type[PT_ALL_STATEMENT_SIG], 1);
+      test_assert_eq(state, stats.nodes_by_type[PT_ALL_TY_TUP], 2);
+      test_assert_eq(state, stats.nodes_by_type[PT_ALL_TY_CONSTRUCTOR_NAME], 4);
+      test_assert_eq(state,
+                     stats.bytes_by_type[PT_ALL_TY_TUP] -
+                       stats.bytes_by_type[PT_ALL_STATEMENT_SIG] * 2,
+                     sizeof(node_ind_t) * 5);
+      test_assert_eq(state, stats.max_depth, 4);
+      test_assert_eq(state, stats.depth_sum, 21);
+      test_assert_eq(state, stats.fan_out[0], 4);
+      test_assert_eq(state, stats.fan_out[1], 1);
+      test_assert_eq(state, stats.fan_out[2], 1);
+      test_assert_eq(state, stats.fan_out[3], 1);
+    }
+    free_parse_tree_res(pres);
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+static void test_node_layout(test_state *state) {
+  test_group_start(state, "Node data");
+  test_start(state, "Is small");
+#ifdef NARROW_INDICES
+  test_assert_eq(state, sizeof(parse_node_data), 4);
+#else
+  test_assert_eq(state, sizeof(parse_node_data), 8);
+#endif
+  test_end(state);
+  test_group_end(state);
+}
+
 void test_parser(test_state *state) {
   test_group_start(state, "Parser");
+  test_node_layout(state);
   test_call_succeeds(state);
   test_parser_succeeds(state);
   test_parser_fails(state);
+  test_parser_streams_input(state);
+  test_parser_parallel(state);
+  test_parser_spans(state);
+  test_parser_ast_cache(state);
+  test_parser_max_depth(state);
+  test_parser_stats(state);
   test_group_end(state);
 }
@@ -3,6 +3,8 @@
 // license that can be found in the LICENSE file.
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "consts.h"
 #include "defs.h"
@@ -21,7 +23,11 @@ static source_file test_file(const char *restrict input) {
 static void test_token_layout(test_state *restrict state) {
   test_group_start(state, "Token");
   test_start(state, "Is small");
+#ifdef NARROW_INDICES
+  test_assert_eq(state, sizeof(token), 6);
+#else
   test_assert_eq(state, sizeof(token), 8);
+#endif
   test_end(state);
   test_group_end(state);
 }
@@ -37,26 +43,20 @@ static void test_scanner_tokens(test_state *restrict state,
     bool tokens_match = tres.token_amt == token_amt + 1;
     if (tokens_match) {
       for (size_t i = 0; i < token_amt; i++) {
-        tokens_match &= tokens[i] == tres.tokens[i].type;
+        tokens_match &= tokens[i] == tres.types[i];
       }
     }
     if (!tokens_match) {
       char *exp = print_tokens_str(tokens, token_amt);
-      size_t token_type_bytes = sizeof(token_type) * tres.token_amt;
-      token_type *got_tokens = stalloc(token_type_bytes);
-      for (size_t i = 0; i < tres.token_amt; i++) {
-        got_tokens[i] = tres.tokens[i].type;
-      }
-      char *got = print_tokens_str(got_tokens, tres.token_amt);
+      char *got = print_tokens_str(tres.types, tres.token_amt);
       failf(state, "Token mismatch: Expected %s, got %s", exp, got);
-      stfree(got_tokens, token_type_bytes);
       free(exp);
       free(got);
     }
-    free(tres.tokens);
   } else {
     failf(state, "Expected scanner to succeed");
   }
+  free_tokens_res(tres);
 }
 
 static void test_scanner_fails(test_state *restrict state, char *restrict input,
@@ -67,6 +67,7 @@ static void test_scanner_fails(test_state *restrict state, char *restrict input,
 
   if (tres.succeeded) {
     failf(state, "Expected to see a tokenizer error for input: %s", input);
+    free_tokens_res(tres);
     return;
   }
   if (tres.error_pos != err_pos) {
@@ -77,6 +78,7 @@ static void test_scanner_fails(test_state *restrict state, char *restrict input,
           err_pos,
           tres.error_pos);
   }
+  free_tokens_res(tres);
 }
 
 static void test_scanner_accepts(test_state *restrict state) {
@@ -183,6 +185,26 @@ static void test_scanner_accepts(test_state *restrict state) {
     test_end(state);
   }
 
+  {
+    test_start(state, "Whitespace runs");
+    static const token_type tokens[] = {
+      TK_OPEN_PAREN, TK_LOWER_NAME, TK_INT, TK_CLOSE_PAREN};
+    // long enough to cover whole SIMD chunks, and the unaligned head/tail
+    test_scanner_tokens(state,
+                        " \t\n\r\v\f                                  (a\n"
+                        "                                                 "
+                        "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t42 \n\n)"
+                        "                                                 ",
+                        STATIC_LEN(tokens),
+                        tokens);
+    test_scanner_tokens(state,
+                        "(a\n  42\n   )",
+                        STATIC_LEN(tokens),
+                        tokens);
+    test_scanner_tokens(state, "                                 ", 0, NULL);
+    test_end(state);
+  }
+
   {
     test_start(state, "String");
     static const token_type tokens[] = {TK_STRING};
@@ -202,7 +224,10 @@ static void test_scan_all(test_state *restrict state) {
     tokens_res res = scan_all(test_file(input));
     test_assert_eq(state, res.succeeded, true);
     test_assert_eq(state, res.token_amt, 5);
-    free(res.tokens);
+    test_assert_eq(state, res.types[3], TK_UNIT);
+    test_assert_eq(state, res.starts[3], 3);
+    test_assert_eq(state, res.lens[3], 2);
+    free_tokens_res(res);
     test_end(state);
   }
 
@@ -212,9 +237,68 @@ static void test_scan_all(test_state *restrict state) {
     tokens_res res = scan_all(test_file(input));
     test_assert_eq(state, res.succeeded, false);
     test_assert_eq(state, res.error_pos, 2);
-    free(res.tokens);
+    free_tokens_res(res);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Symbols");
+    char *input = "(abc Def abc 1 Def)";
+    tokens_res res = scan_all(test_file(input));
+    test_assert_eq(state, res.succeeded, true);
+    test_assert_eq(state, res.symbols[0], SYMBOL_NONE);
+    test_assert_eq(state, res.symbols[1], res.symbols[3]);
+    test_assert_eq(state, res.symbols[2], res.symbols[5]);
+    test_assert(state, res.symbols[1] != res.symbols[2]);
+    test_assert_eq(state, res.symbols[4], SYMBOL_NONE);
+    test_assert_eq(state, symbol_amount(res.symbol_table), 2);
+    test_assert_eq(state, symbol_len(res.symbol_table, res.symbols[2]), 3);
+    test_assert(
+      state,
+      memcmp(symbol_name(res.symbol_table, res.symbols[2]), "Def", 3) == 0);
+    free_tokens_res(res);
+    test_end(state);
+  }
+
+  {
+    // Even lengths give odd capacities, which used to leave the symbols
+    // misaligned, when starts were narrower than them
+    test_start(state, "Aligned arrays");
+    char *input = "(ab c)";
+    tokens_res res = scan_all(test_file(input));
+    test_assert_eq(state, res.succeeded, true);
+    test_assert_eq(state, (uintptr_t)res.symbols % sizeof(symbol_id), 0);
+    test_assert_eq(state, (uintptr_t)res.starts % sizeof(buf_ind_t), 0);
+    test_assert_eq(state, (uintptr_t)res.lens % sizeof(token_len_t), 0);
+    test_assert(state, res.symbols[1] != res.symbols[2]);
+    test_assert_eq(state, res.symbols[3], SYMBOL_NONE);
+    free_tokens_res(res);
+    test_end(state);
+  }
+
+#ifdef NARROW_INDICES
+  {
+    test_start(state, "Longest source");
+    char *input = malloc((size_t)SOURCE_LEN_MAX + 2);
+    memset(input, ' ', (size_t)SOURCE_LEN_MAX + 1);
+    input[SOURCE_LEN_MAX] = '\0';
+    tokens_res res = scan_all(test_file(input));
+    test_assert_eq(state, res.succeeded, true);
+    if (res.succeeded) {
+      test_assert_eq(state, res.starts[0], SOURCE_LEN_MAX);
+    }
+    free_tokens_res(res);
+
+    input[SOURCE_LEN_MAX] = ' ';
+    input[SOURCE_LEN_MAX + 1] = '\0';
+    res = scan_all(test_file(input));
+    test_assert_eq(state, res.succeeded, false);
+    test_assert_eq(state, res.too_long, true);
+    free_tokens_res(res);
+    free(input);
     test_end(state);
   }
+#endif
 
   test_group_end(state);
 }
@@ -249,11 +333,179 @@ static void test_scanner_rejects(test_state *restrict state) {
   test_group_end(state);
 }
 
+static bool tokens_res_eq(tokens_res a, tokens_res b) {
+  if (a.succeeded != b.succeeded)
+    return false;
+  if (!a.succeeded)
+    return a.error_pos == b.error_pos;
+  return a.token_amt == b.token_amt &&
+         memcmp(a.types, b.types, a.token_amt * sizeof(token_type)) == 0 &&
+         memcmp(a.starts, b.starts, a.token_amt * sizeof(buf_ind_t)) == 0 &&
+         memcmp(a.lens, b.lens, a.token_amt * sizeof(token_len_t)) == 0 &&
+         memcmp(a.symbols, b.symbols, a.token_amt * sizeof(symbol_id)) == 0;
+}
+
+// Small inputs, split into lots of chunks, so that some cuts land
+// mid-token and in strings
+static void test_scan_chunked_matches(test_state *restrict state,
+                                      const char *restrict input) {
+  tokens_res expected = scan_all(test_file(input));
+  for (unsigned chunk_amt = 2; chunk_amt <= 9; chunk_amt++) {
+    tokens_res got = scan_all_chunked(test_file(input), chunk_amt);
+    if (!tokens_res_eq(expected, got)) {
+      failf(state, "Scanning in %u chunks differs from serial", chunk_amt);
+    }
+    free_tokens_res(got);
+  }
+  free_tokens_res(expected);
+}
+
+static void test_scan_chunked(test_state *restrict state) {
+  test_group_start(state, "Scan chunked");
+
+  {
+    test_start(state, "Top-level forms");
+    test_scan_chunked_matches(state,
+                              "(sig (Fn I32 I32))\n"
+                              "(fun a (b) (if b 1 2))\n"
+                              "(fun c () (a 3))\n"
+                              "(data Pair [a b] (Pair a b))\n");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Cuts inside strings");
+    test_scan_chunked_matches(state,
+                              "(fun a () \"\\n(not a form) \\\"( ) (\")\n"
+                              "(fun b () \"  (  (  (  \")\n");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Failure");
+    test_scan_chunked_matches(state, "(a)\n(b)\n(c ;)\n(d)\n(e)");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Empty");
+    test_scan_chunked_matches(state, "");
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
+// Symbol IDs can differ, as rescanning keeps the old ones
+static bool tokens_res_same_tokens(tokens_res a, tokens_res b) {
+  if (a.succeeded != b.succeeded)
+    return false;
+  if (!a.succeeded)
+    return a.error_pos == b.error_pos;
+  if (a.token_amt != b.token_amt ||
+      memcmp(a.types, b.types, a.token_amt * sizeof(token_type)) != 0 ||
+      memcmp(a.starts, b.starts, a.token_amt * sizeof(buf_ind_t)) != 0 ||
+      memcmp(a.lens, b.lens, a.token_amt * sizeof(token_len_t)) != 0)
+    return false;
+  for (size_t i = 0; i < a.token_amt; i++) {
+    if ((a.symbols[i] == SYMBOL_NONE) != (b.symbols[i] == SYMBOL_NONE))
+      return false;
+    if (a.symbols[i] != SYMBOL_NONE &&
+        (symbol_len(a.symbol_table, a.symbols[i]) !=
+           symbol_len(b.symbol_table, b.symbols[i]) ||
+         memcmp(symbol_name(a.symbol_table, a.symbols[i]),
+                symbol_name(b.symbol_table, b.symbols[i]),
+                symbol_len(a.symbol_table, a.symbols[i])) != 0))
+      return false;
+  }
+  return true;
+}
+
+// Replaces `old_len` bytes at `start` of `before` with `replacement`
+static void test_rescan_matches(test_state *restrict state,
+                                const char *restrict before, buf_ind_t start,
+                                buf_ind_t old_len,
+                                const char *restrict replacement) {
+  size_t before_len = strlen(before);
+  size_t replacement_len = strlen(replacement);
+  char *after = malloc(before_len - old_len + replacement_len + 1);
+  memcpy(after, before, start);
+  memcpy(after + start, replacement, replacement_len);
+  strcpy(after + start + replacement_len, before + start + old_len);
+
+  source_edit edit = {
+    .start = start,
+    .old_end = start + old_len,
+    .new_end = start + replacement_len,
+  };
+  tokens_res got = scan_all(test_file(before));
+  rescan_edit(&got, test_file(after), edit);
+  tokens_res expected = scan_all(test_file(after));
+  if (!tokens_res_same_tokens(expected, got)) {
+    failf(state, "Rescanning '%s' differs from scanning it", after);
+  }
+  free_tokens_res(expected);
+  free_tokens_res(got);
+  free(after);
+}
+
+static void test_rescan(test_state *restrict state) {
+  test_group_start(state, "Rescan");
+
+  const char *input = "(fun a (b) (if b 12 \"hi\"))\n(fun c () (a 3))";
+
+  {
+    test_start(state, "Insertion");
+    test_rescan_matches(state, input, 5, 0, "x");
+    test_rescan_matches(state, input, 6, 0, "bc");
+    test_rescan_matches(state, input, 18, 0, "3");
+    test_rescan_matches(state, input, 0, 0, " ");
+    test_rescan_matches(state, input, strlen(input), 0, " (d)");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Deletion");
+    test_rescan_matches(state, input, 6, 1, "");
+    test_rescan_matches(state, input, 4, 1, "");
+    test_rescan_matches(state, input, 0, 1, "");
+    test_rescan_matches(state, input, 27, 1, "");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Replacement");
+    test_rescan_matches(state, input, 1, 3, "sig");
+    test_rescan_matches(state, input, 7, 3, "()");
+    test_rescan_matches(state, input, 0, strlen(input), "(a)");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Strings");
+    test_rescan_matches(state, input, 20, 1, "(");
+    test_rescan_matches(state, input, 23, 0, " ) (");
+    test_rescan_matches(state, input, 11, 0, "\"");
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Failure");
+    test_rescan_matches(state, input, 5, 0, ";");
+    test_rescan_matches(state, "(a ;)", 3, 1, "b");
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
 void test_scanner(test_state *state) {
   test_group_start(state, "Scanner");
   test_token_layout(state);
   test_scanner_accepts(state);
   test_scanner_rejects(state);
   test_scan_all(state);
+  test_scan_chunked(state);
+  test_rescan(state);
   test_group_end(state);
 }
@@ -2,8 +2,11 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "strint.h"
 #include "test.h"
@@ -759,6 +762,139 @@ static void test_strint_i64(test_state *state) {
   test_group_end(state); // i64
 }
 
+// Every length is handled by a different mix of wide and narrow steps
+static void test_strint_lengths(test_state *state) {
+  test_group_start(state, "lengths");
+
+  test_start(state, "base 10");
+  {
+    char str[32];
+    uint64_t ones = 0;
+    uint64_t nines = 0;
+    for (size_t len = 1; len <= 19; len++) {
+      ones = ones * 10 + 1;
+      nines = nines * 10 + 9;
+      memset(str, '1', len);
+      str[len] = '\0';
+      bool overflowed = false;
+      test_assert_eq(state, parse_uint64_base10(&overflowed, str, len), ones);
+      test_assert(state, !overflowed);
+      memset(str, '9', len);
+      test_assert_eq(state, parse_uint64_base10(&overflowed, str, len), nines);
+      test_assert(state, !overflowed);
+    }
+    memset(str, '9', 20);
+    str[20] = '\0';
+    bool overflowed = false;
+    parse_uint64_base10(&overflowed, str, 20);
+    test_assert(state, overflowed);
+  }
+  test_end(state);
+
+  test_start(state, "base 16");
+  {
+    char str[32];
+    uint64_t fs = 0;
+    for (size_t len = 1; len <= 16; len++) {
+      fs = fs << 4 | 0xf;
+      memset(str, len % 2 == 0 ? 'f' : 'F', len);
+      str[len] = '\0';
+      bool overflowed = false;
+      test_assert_eq(state, parse_uint64_base16(&overflowed, str, len), fs);
+      test_assert(state, !overflowed);
+    }
+    bool overflowed = false;
+    test_assert_eq(state,
+                   parse_uint64_base16(&overflowed, "DeadBeefCafeBabe", 16),
+                   0xdeadbeefcafebabe);
+    test_assert_eq(state,
+                   parse_uint64_base16(&overflowed, "0123456789aBcDeF", 16),
+                   0x0123456789abcdef);
+    test_assert(state, !overflowed);
+  }
+  test_end(state);
+
+  test_start(state, "leading zeros");
+  {
+    char str[64];
+    for (size_t zeros = 0; zeros <= 40; zeros++) {
+      memset(str, '0', zeros);
+      strcpy(str + zeros, "18446744073709551615");
+      bool overflowed = false;
+      test_assert_eq(state,
+                     parse_uint64_base10(&overflowed, str, strlen(str)),
+                     UINT64_MAX);
+      test_assert(state, !overflowed);
+      strcpy(str + zeros, "ffffffffffffffff");
+      test_assert_eq(state,
+                     parse_uint64_base16(&overflowed, str, strlen(str)),
+                     UINT64_MAX);
+      test_assert(state, !overflowed);
+      str[zeros] = '\0';
+      test_assert_eq(state, parse_uint64_base10(&overflowed, str, zeros), 0);
+      test_assert_eq(state, parse_uint64_base16(&overflowed, str, zeros), 0);
+      test_assert(state, !overflowed);
+    }
+  }
+  test_end(state);
+
+  test_group_end(state); // lengths
+}
+
+static void test_strint_exhaustive(test_state *state) {
+  test_group_start(state, "exhaustive");
+
+  test_start(state, "u16 base 10");
+  {
+    char str[16];
+    for (uint32_t i = 0; i < 100000; i++) {
+      snprintf(str, sizeof(str), "%" PRIu32, i);
+      bool overflowed = false;
+      uint16_t res = parse_uint16_base10(&overflowed, str, strlen(str));
+      if (overflowed != (i > UINT16_MAX) || (!overflowed && res != i)) {
+        failf(state, "Parsed '%s' wrong", str);
+        break;
+      }
+    }
+  }
+  test_end(state);
+
+  test_start(state, "u16 base 16");
+  {
+    char str[16];
+    for (uint32_t i = 0; i < 0x100000; i++) {
+      snprintf(str, sizeof(str), i % 2 == 0 ? "%" PRIx32 : "%" PRIX32, i);
+      bool overflowed = false;
+      uint16_t res = parse_uint16_base16(&overflowed, str, strlen(str));
+      if (overflowed != (i > UINT16_MAX) || (!overflowed && res != i)) {
+        failf(state, "Parsed '%s' wrong", str);
+        break;
+      }
+    }
+  }
+  test_end(state);
+
+  test_start(state, "i16 base 10");
+  {
+    char str[16];
+    for (int32_t i = -99999; i < 100000; i++) {
+      snprintf(str, sizeof(str), "%" PRId32, i);
+      flow_type flow = INT_FITS;
+      int16_t res = parse_int16_base10(&flow, str, strlen(str));
+      flow_type exp_flow = i > INT16_MAX   ? OVERFLOW
+                           : i < INT16_MIN ? UNDERFLOW
+                                           : INT_FITS;
+      if (flow != exp_flow || (flow == INT_FITS && res != i)) {
+        failf(state, "Parsed '%s' wrong", str);
+        break;
+      }
+    }
+  }
+  test_end(state);
+
+  test_group_end(state); // exhaustive
+}
+
 void test_strint(test_state *state) {
   test_group_start(state, "strint");
 
@@ -770,6 +906,8 @@ void test_strint(test_state *state) {
   test_strint_i32(state);
   test_strint_u64(state);
   test_strint_i64(state);
+  test_strint_lengths(state);
+  test_strint_exhaustive(state);
 
   test_group_end(state);
 }
@@ -161,7 +161,7 @@ static void test_elems_match(test_state *state, pt_traversal *traversal,
         break;
       case TR_ANNOTATE: {
         parse_node_type_all at =
-          traversal->nodes[a.data.annotation_data.target_index].type.all;
+          PT_NODE_TAG(*traversal, a.data.annotation_data.target_index);
         if (at != b.data.node_type) {
           node_type_mismatch(state, i, elems, b.data.node_type, at);
           return;
@@ -8,6 +8,7 @@
 
 #include "diagnostic.h"
 #include "parse_tree.h"
+#include "share_subtrees.h"
 #include "test.h"
 #include "tests.h"
 #include "test_upto.h"
@@ -129,7 +130,7 @@ static bool test_err_eq(parse_tree tree, tc_res res, size_t err_ind,
   tc_error eA = res.errors[err_ind];
   if (eA.type != test_err.type)
     return false;
-  if (!spans_equal(tree.spans[eA.pos], err_span))
+  if (!spans_equal(pt_node_span(&tree, eA.pos), err_span))
     return false;
   switch (eA.type) {
     case TC_ERR_CONFLICT: {
@@ -221,7 +222,9 @@ static void test_types_match(test_state *state, const char *input_p,
     ss_init_immovable(&ss);
     fprintf(
       ss.stream, "Didn't expect typecheck errors. Got %d:\n", res.error_amt);
-    print_tc_errors(ss.stream, input, rres.tree, res);
+    line_index lines = build_line_index(input);
+    print_tc_errors(ss.stream, &lines, rres.tree, res);
+    free_line_index(lines);
     ss_finalize(&ss);
     failf(state, ss.string, input);
     free(ss.string);
@@ -231,7 +234,7 @@ static void test_types_match(test_state *state, const char *input_p,
       span span = spans[i];
       bool seen = false;
       for (size_t j = 0; j < rres.tree.node_amt; j++) {
-        if (spans_equal(rres.tree.spans[j], span)) {
+        if (spans_equal(pt_node_span(&rres.tree, j), span)) {
           seen = true;
           if (!test_type_eq(res.types.tree.nodes,
                             res.types.tree.inds,
@@ -252,7 +255,9 @@ static void test_types_match(test_state *state, const char *input_p,
             {
               stringstream ss;
               ss_init_immovable(&ss);
-              format_error_ctx(ss.stream, input, span.start, span.len);
+              line_index lines = build_line_index(input);
+              format_error_ctx(ss.stream, &lines, span.start, span.len);
+              free_line_index(lines);
               ss_finalize(&ss);
               context_str = ss.string;
             }
@@ -280,6 +285,65 @@ static void test_types_match(test_state *state, const char *input_p,
   free(input);
 }
 
+static char *print_root_types(parse_tree tree, tc_res res) {
+  stringstream ss;
+  ss_init_immovable(&ss);
+  for (node_ind_t i = 0; i < tree.root_subs_amt; i++) {
+    node_ind_t root = tree.inds[tree.root_subs_start + i];
+    print_type(ss.stream,
+               res.types.tree.nodes,
+               res.types.tree.inds,
+               res.types.node_types[root]);
+    putc('\n', ss.stream);
+  }
+  ss_finalize(&ss);
+  return ss.string;
+}
+
+// Sharing shouldn't change what the program looks like, or how it checks
+static void test_shares_subtrees(test_state *state, const char *input,
+                                 node_ind_t nodes_removed) {
+  upto_resolution_res rres = test_upto_resolution(state, input);
+  if (!rres.success) {
+    return;
+  }
+  char *tree_before = print_parse_tree_str(input, rres.tree);
+  tc_res res_before = typecheck(rres.tree);
+  char *types_before = print_root_types(rres.tree, res_before);
+  free_tc_res(res_before);
+
+  share_subtrees_res shared = share_subtrees(&rres.tree, input);
+  if (shared.nodes_removed != nodes_removed) {
+    failf(state,
+          "Expected to remove %u nodes, removed %u",
+          nodes_removed,
+          shared.nodes_removed);
+  }
+  char *tree_after = print_parse_tree_str(input, rres.tree);
+  if (strcmp(tree_before, tree_after) != 0) {
+    failf(state, "Sharing changed the tree:\n%s\n%s", tree_before, tree_after);
+  }
+  tc_res res_after = typecheck(rres.tree);
+  if (res_after.error_amt > 0) {
+    failf(state, "Typecheck failed after sharing subtrees");
+  } else {
+    char *types_after = print_root_types(rres.tree, res_after);
+    if (strcmp(types_before, types_after) != 0) {
+      failf(state,
+            "Sharing changed the types:\n%s\n%s",
+            types_before,
+            types_after);
+    }
+    free(types_after);
+  }
+
+  free_tc_res(res_after);
+  free(tree_after);
+  free(types_before);
+  free(tree_before);
+  free_parse_tree(rres.tree);
+}
+
 static void test_typecheck_errors(test_state *state, const char *input_p,
                                   const tc_err_test *exps, node_ind_t cases) {
   size_t span_bytes = sizeof(span) * cases;
@@ -304,7 +368,9 @@ static void test_typecheck_errors(test_state *state, const char *input_p,
     if (res.error_amt > 0) {
       fputs("Errors:\n", ss.stream);
     }
-    print_tc_errors(ss.stream, input, rres.tree, res);
+    line_index lines = build_line_index(input);
+    print_tc_errors(ss.stream, &lines, rres.tree, res);
+    free_line_index(lines);
     ss_finalize(&ss);
     failf(state,
           "Expected %d errors, got %d.\n%s",
@@ -557,6 +623,19 @@ static void test_typecheck_succeeds(test_state *state) {
     test_end(state);
   }
 
+  {
+    test_start(state, "Tuple elements");
+    const char *input = "(sig (Fn (I32, U8, I16)))\n"
+                        "(fun test () (→1←, →2←, →3←))";
+    test_type types[] = {
+      i32_t,
+      u8_t,
+      i16_t,
+    };
+    test_types_match(state, input, types, STATIC_LEN(types));
+    test_end(state);
+  }
+
   {
     test_start(state, "Uses let");
     const char *input = "(sig (Fn I32))\n"
@@ -662,6 +741,23 @@ static void test_typecheck_succeeds(test_state *state) {
     test_end(state);
   }
 
+  {
+    test_start(state, "Bindings shadow builtins");
+    const char *input = "(sig (Fn I8 Bool))\n"
+                        "(fun a (i32-add)\n"
+                        "  (let b →i32-add←)\n"
+                        "  (sig (Fn U8 U8))\n"
+                        "  (fun c (i8-gt?) →i8-gt?←)\n"
+                        "  (i8-gt? 1 →2←))";
+    test_type types[] = {
+      i8_t,
+      u8_t,
+      i8_t,
+    };
+    test_types_match(state, input, types, STATIC_LEN(types));
+    test_end(state);
+  }
+
   {
     test_start(state, "Type inference");
     const char *input = "(sig (Fn Bool))\n"
@@ -704,6 +800,45 @@ static void test_errors(test_state *state) {
     test_end(state);
   }
 
+  {
+    test_start(state, "(a, b) vs (c, d, e)");
+    // The signature's types are still variables here
+    const test_type exp_subs[] = {
+      VAR_A,
+      VAR_B,
+    };
+    const test_type exp = {
+      .tag = TC_TUP,
+      .data.subs =
+        {
+          .amt = STATIC_LEN(exp_subs),
+          .arr = exp_subs,
+        },
+    };
+    const test_type got_subs[] = {
+      {.tag = TC_VAR, .data.type_var = 2},
+      {.tag = TC_VAR, .data.type_var = 3},
+      {.tag = TC_VAR, .data.type_var = 4},
+    };
+    const test_type got = {
+      .tag = TC_TUP,
+      .data.subs =
+        {
+          .amt = STATIC_LEN(got_subs),
+          .arr = got_subs,
+        },
+    };
+    const tc_err_test errors[] = {{
+      .type = TC_ERR_CONFLICT,
+      .type_exp = exp,
+      .type_got = got,
+    }};
+    static const char *prog = "(sig (Fn (I32, I32)))\n"
+                              "(fun a () →(2, 3, 4)←)";
+    test_typecheck_errors(state, prog, errors, STATIC_LEN(errors));
+    test_end(state);
+  }
+
   {
     test_start(state, "I32 vs (() -> Int)");
     const test_type got = {
@@ -846,6 +981,50 @@ static void test_kitchen_sink(test_state *state) {
   test_group_end(state);
 }
 
+static void test_shared_subtrees(test_state *state) {
+  test_group_start(state, "Shared subtrees");
+
+  {
+    test_start(state, "Repeated signatures");
+    const char *input = "(sig (Fn I32 I32))\n"
+                        "(fun a (x) x)\n"
+                        "(sig (Fn I32 I32))\n"
+                        "(fun b (x) x)";
+    test_shares_subtrees(state, input, 4);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Literals");
+    const char *input = "(sig (Fn () [U8]))\n"
+                        "(fun a (()) \"hi\")\n"
+                        "(sig (Fn () [U8]))\n"
+                        "(fun b (()) \"hi\")";
+    test_shares_subtrees(state, input, 6);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Nested types");
+    const char *input = "(sig (Fn (I32, I32) [(I32, I32)]))\n"
+                        "(fun a (x) [x])";
+    test_shares_subtrees(state, input, 4);
+    test_end(state);
+  }
+
+  {
+    test_start(state, "Integer literals");
+    const char *input = "(sig (Fn I32))\n"
+                        "(fun a () 1)\n"
+                        "(sig (Fn I64))\n"
+                        "(fun b () 1)";
+    test_shares_subtrees(state, input, 0);
+    test_end(state);
+  }
+
+  test_group_end(state);
+}
+
 static void test_typecheck_stress(test_state *state) {
   test_start(state, "Stress");
   {
@@ -880,6 +1059,7 @@ void test_typecheck(test_state *state) {
     test_typecheck_stress(state);
   }
   test_kitchen_sink(state);
+  test_shared_subtrees(state);
 
   test_group_end(state);
 }
@@ -2,9 +2,10 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <string.h>
+
 #include "defs.h"
 #include "diagnostic.h"
-#include "externalise_spans.h"
 #include "test.h"
 #include "test_upto.h"
 #include "test_llvm.h"
@@ -24,6 +25,12 @@ void add_scanner_timings_internal(test_state *state, const char *restrict input,
     perf_add(state->total_tokenization_perf, tres.perf_values);
   state->total_tokens_produced += tres.token_amt;
 }
+
+void add_rescan_timings_internal(test_state *state, tokens_res tres) {
+  state->total_rescan_perf =
+    perf_add(state->total_rescan_perf, tres.perf_values);
+  state->total_rescans++;
+}
 #endif
 
 #ifdef TIME_PARSER
@@ -38,6 +45,9 @@ void add_parser_timings_internal(test_state *state, tokens_res tres,
   state->total_parser_perf =
     perf_add(state->total_parser_perf, pres.perf_values);
   state->total_parse_nodes_produced += pres.tree.node_amt;
+  if (pres.success) {
+    parse_tree_stats_add(&state->total_parse_tree_stats, pres.tree);
+  }
 }
 #endif
 
@@ -79,10 +89,11 @@ tokens_res test_upto_tokens(test_state *state, const char *restrict input) {
   if (!tres.succeeded) {
     stringstream ss;
     ss_init_immovable(&ss);
-    format_error_ctx(ss.stream, input, tres.error_pos, 1);
+    line_index lines = build_line_index(input);
+    print_tokens_error(ss.stream, &lines, tres);
+    free_line_index(lines);
     ss_finalize(&ss);
-    failf(state, "Scanning failed:\n%s", ss.string);
-    free_tokens_res(tres);
+    failf(state, "%s", ss.string);
     free(ss.string);
   }
 
@@ -108,12 +119,12 @@ parse_tree_res test_upto_parse_tree(test_state *state,
     return res;
   }
 
-  const parse_tree_res pres = parse(tres.tokens, tres.token_amt);
+  const parse_tree_res pres = parse(tres);
 
   add_parser_timings(state, tres, pres);
 
   if (!pres.success) {
-    char *error = print_parse_errors_string(input, tres.tokens, pres);
+    char *error = print_parse_errors_string(input, pres);
     failf(state, "Parsing failed:\n%s", error);
     free(error);
   }
@@ -135,6 +146,22 @@ upto_resolution_res test_upto_resolution(test_state *state,
 
   add_name_resolution_timings(state, res_res);
 
+  // The hashed resolver has to agree, binding for binding
+  {
+    const size_t data_bytes = sizeof(parse_node_data) * tree_res.tree.node_amt;
+    parse_node_data *expected = malloc(data_bytes);
+    memcpy(expected, tree_res.tree.node_data, data_bytes);
+    resolution_res hashed_res =
+      resolve_bindings_with(tree_res.tree, input, RESOLVER_HASHED);
+    test_assert_eq(state,
+                   hashed_res.not_found.binding_amt,
+                   res_res.not_found.binding_amt);
+    test_assert_eq(
+      state, memcmp(tree_res.tree.node_data, expected, data_bytes), 0);
+    free(hashed_res.not_found.bindings);
+    free(expected);
+  }
+
   if (res_res.not_found.binding_amt > 0) {
     const upto_resolution_res res = {
       .success = false,
@@ -146,7 +173,6 @@ upto_resolution_res test_upto_resolution(test_state *state,
     free_parse_tree_res(tree_res);
     return res;
   } else {
-    externalise_spans(&tree_res.tree);
     const upto_resolution_res res = {
       .success = true,
       .tree = tree_res.tree,
@@ -169,7 +195,9 @@ tc_res test_upto_typecheck(test_state *state, const char *restrict input,
       *success = false;
       stringstream ss;
       ss_init_immovable(&ss);
-      print_tc_errors(ss.stream, input, tree_res.tree, tc);
+      line_index lines = build_line_index(input);
+      print_tc_errors(ss.stream, &lines, tree_res.tree, tc);
+      free_line_index(lines);
       ss_finalize(&ss);
       failf(state, "Typecheck failed:\n%s", ss.string);
       free(ss.string);
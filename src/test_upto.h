@@ -20,8 +20,11 @@
 #define add_scanner_timings(...) add_scanner_timings_internal(__VA_ARGS__)
 void add_scanner_timings_internal(test_state *state, const char *restrict input,
                                   tokens_res tres);
+#define add_rescan_timings(...) add_rescan_timings_internal(__VA_ARGS__)
+void add_rescan_timings_internal(test_state *state, tokens_res tres);
 #else
 #define add_scanner_timings(...) pass
+#define add_rescan_timings(...) pass
 #endif
 
 #ifdef TIME_PARSER
@@ -12,6 +12,7 @@
 #include "consts.h"
 #include "perf.h"
 #include "source.h"
+#include "symbol_table.h"
 #include "vec.h"
 
 typedef unsigned char token_type;
@@ -30,18 +31,59 @@ typedef struct {
 } token_res;
 
 VEC_DECL(token);
+VEC_DECL_CUSTOM(token_len_t, vec_token_len);
 
+// Tokens are stored as a struct of arrays, so that the parser's hot loop,
+// which mostly looks at types, touches as little memory as possible.
+// All four arrays live in a single allocation, owned by `symbols`.
 typedef struct {
-  token *tokens;
+  buf_ind_t *starts;
+  // SYMBOL_NONE for anything but names
+  symbol_id *symbols;
+  token_len_t *lens;
+  token_type *types;
   size_t token_amt;
+  // how many tokens the arrays have room for
+  size_t token_cap;
+  // names, interned as they're scanned
+  symbol_table *symbol_table;
   buf_ind_t error_pos;
   bool succeeded;
+  // The source was longer than SOURCE_LEN_MAX, so it wasn't scanned, and
+  // there's no error_pos
+  bool too_long;
 #ifdef TIME_TOKENIZER
   perf_values perf_values;
 #endif
 } tokens_res;
 
+// Scans the token starting at, or after whitespace following, `start`
+token_res scan(source_file file, buf_ind_t start);
 tokens_res scan_all(source_file file);
+// `scan_all`, for when the source's length is already known
+tokens_res scan_all_len(source_file file, size_t len);
+// Splits the file into `chunk_amt` chunks, and scans them concurrently.
+// Produces the same result as `scan_all`.
+tokens_res scan_all_chunked(source_file file, unsigned chunk_amt);
+// `scan_all_chunked`, with as many chunks as is worthwhile for this machine
+tokens_res scan_all_parallel(source_file file);
+// Allocates room for `cap` tokens, in one allocation
+tokens_res alloc_tokens_res(size_t cap);
+
+// Bytes [start, old_end) of the old source were replaced by bytes
+// [start, new_end) of the new one
+typedef struct {
+  buf_ind_t start;
+  buf_ind_t old_end;
+  buf_ind_t new_end;
+} source_edit;
+
+// Updates `res`, the tokens of the source before `edit`, to the tokens of
+// `file`. Only the tokens the edit can affect are rescanned, and the rest are
+// shifted into place. Names that didn't change keep their symbol IDs.
+void rescan_edit(tokens_res *res, source_file file, source_edit edit);
+// Returns the name's symbol, or SYMBOL_NONE if `t` isn't a name
+symbol_id intern_token(symbol_table *table, source_file file, token t);
 void free_tokens_res(tokens_res res);
 void print_token(FILE *f, token_type t);
 void print_tokens(FILE *f, const token_type *tokens, unsigned token_amt);
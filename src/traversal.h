@@ -99,13 +99,24 @@ typedef struct {
 } traversal_wanted_actions;
 
 typedef struct {
-  const parse_node *restrict nodes;
+  // the tree's arrays that the walk needs, see parse_tree
+  const u8 *restrict tags;
+  const parse_node_data *restrict node_data;
   const node_ind_t *restrict inds;
-  vec_traverse_action actions;
+  // These stacks are sized from the tree's max_depth up front, so they never
+  // grow. They live in one allocation, which `actions` owns.
+  traverse_action_internal *actions;
+  u32 actions_len;
   environment_ind_t environment_amt;
-  vec_environment_ind environment_len_stack;
-  // two names for the same stack
-  vec_node_ind node_stack;
+  environment_ind_t *environment_len_stack;
+  u32 environment_len_stack_len;
+  node_ind_t *node_stack;
+  u32 node_stack_len;
+#ifndef NDEBUG
+  u32 actions_cap;
+  u32 environment_len_stack_cap;
+  u32 node_stack_cap;
+#endif
   traverse_mode mode;
   traversal_wanted_actions wanted_actions;
 } pt_traversal;
@@ -7,6 +7,7 @@
 #include "builtins.h"
 #include "parse_tree.h"
 #include "traverse.h"
+#include "util.h"
 
 // TODO rename push_scope(function) to declare_function
 
@@ -83,11 +84,34 @@ static uint8_t should_annotate = (1 << TRAVERSE_TYPECHECK);
 
 static uint8_t should_add_blocks = (1 << TRAVERSE_CODEGEN);
 
+// The most actions, and node stack entries, that visiting a node leaves on
+// the stack besides its children's. A FUN statement pushes five actions, and
+// a signature pushes four nodes, as its annotation needs two.
+#define TR_MAX_ACTIONS_PER_NODE 5
+#define TR_MAX_NODES_PER_NODE 4
+
+// The stacks are sized up front, see pt_walk
+static void tr_push_raw_action(pt_traversal *traversal,
+                               traverse_action_internal action) {
+  debug_assert(traversal->actions_len < traversal->actions_cap);
+  traversal->actions[traversal->actions_len++] = action;
+}
+
+static void tr_push_node_index(pt_traversal *traversal,
+                               node_ind_t node_index) {
+  debug_assert(traversal->node_stack_len < traversal->node_stack_cap);
+  traversal->node_stack[traversal->node_stack_len++] = node_index;
+}
+
+static node_ind_t tr_pop_node_index(pt_traversal *traversal) {
+  return traversal->node_stack[--traversal->node_stack_len];
+}
+
 static void tr_push_action(pt_traversal *traversal,
                            traverse_action_internal action,
                            node_ind_t node_index) {
-  VEC_PUSH(&traversal->actions, action);
-  VEC_PUSH(&traversal->node_stack, node_index);
+  tr_push_raw_action(traversal, action);
+  tr_push_node_index(traversal, node_index);
 }
 
 static void tr_push_initial(pt_traversal *traversal, node_ind_t node_index) {
@@ -96,8 +120,7 @@ static void tr_push_initial(pt_traversal *traversal, node_ind_t node_index) {
 
 static void tr_maybe_add_block(pt_traversal *traversal) {
   if (traversal->wanted_actions.add_blocks) {
-    traverse_action_internal action = TR_ACT_NEW_BLOCK;
-    VEC_PUSH(&traversal->actions, action);
+    tr_push_raw_action(traversal, TR_ACT_NEW_BLOCK);
   }
 }
 
@@ -123,27 +146,26 @@ static void traverse_push_block(pt_traversal *traversal, node_ind_t start,
 
 static traversal_node_data traverse_get_parse_node(pt_traversal *traversal) {
   traversal_node_data res;
-  VEC_POP(&traversal->node_stack, &res.node_index);
-  res.node = traversal->nodes[res.node_index];
+  res.node_index = tr_pop_node_index(traversal);
+  res.node = PT_NODE(*traversal, res.node_index);
   return res;
 }
 
 static void tr_push_subs_external(pt_traversal *traversal, parse_node node) {
-  VEC_APPEND_REVERSE(&traversal->node_stack,
-                     node.data.more_subs.amt,
-                     &traversal->inds[node.data.more_subs.start]);
-  const traverse_action_internal act = TR_ACT_INITIAL;
-  VEC_REPLICATE(&traversal->actions, node.data.more_subs.amt, act);
+  const node_ind_t amt = node.data.more_subs.amt;
+  const node_ind_t *subs = &traversal->inds[node.data.more_subs.start];
+  for (node_ind_t i = 0; i < amt; i++) {
+    tr_push_action(traversal, TR_ACT_INITIAL, subs[amt - 1 - i]);
+  }
 }
 
 static void tr_maybe_annotate(pt_traversal *traversal, node_ind_t node_index) {
   if (traversal->wanted_actions.annotate) {
-    const traverse_action_internal act = TR_ACT_ANNOTATE;
-    VEC_PUSH(&traversal->actions, act);
-    const vec_node_ind stack = traversal->node_stack;
-    const node_ind_t target = VEC_PEEK(stack);
-    VEC_PUSH(&traversal->node_stack, target);
-    VEC_PUSH(&traversal->node_stack, node_index);
+    tr_push_raw_action(traversal, TR_ACT_ANNOTATE);
+    const node_ind_t target =
+      traversal->node_stack[traversal->node_stack_len - 1];
+    tr_push_node_index(traversal, target);
+    tr_push_node_index(traversal, node_index);
   }
 }
 
@@ -152,8 +174,7 @@ static void tr_maybe_push_environment(pt_traversal *traversal,
                                       node_ind_t node_index,
                                       traverse_action_internal act) {
   if (traversal->wanted_actions.edit_environment) {
-    VEC_PUSH(&traversal->actions, act);
-    VEC_PUSH(&traversal->node_stack, node_index);
+    tr_push_action(traversal, act, node_index);
   }
 }
 
@@ -280,15 +301,13 @@ static void tr_push_inout(pt_traversal *traversal, node_ind_t node_index) {
 
 static void tr_maybe_restore_scope(pt_traversal *traversal) {
   if (traversal->wanted_actions.edit_environment) {
-    const traverse_action_internal act = TR_ACT_POP_TO;
-    VEC_PUSH(&traversal->actions, act);
+    tr_push_raw_action(traversal, TR_ACT_POP_TO);
   }
 }
 
 static void tr_maybe_backup_scope(pt_traversal *traversal) {
   if (traversal->wanted_actions.edit_environment) {
-    const traverse_action_internal act = TR_ACT_BACKUP_SCOPE;
-    VEC_PUSH(&traversal->actions, act);
+    tr_push_raw_action(traversal, TR_ACT_BACKUP_SCOPE);
   }
 }
 
@@ -301,7 +320,7 @@ static void pt_traverse_push_letrec(pt_traversal *traversal, node_ind_t start,
     const node_ind_t node_index = traversal->inds[start + amount - 1 - i];
     const traversal_node_data data = {
       .node_index = node_index,
-      .node = traversal->nodes[node_index],
+      .node = PT_NODE(*traversal, node_index),
     };
     switch (data.node.type.statement) {
       case PT_STATEMENT_FUN: {
@@ -318,8 +337,7 @@ static void pt_traverse_push_letrec(pt_traversal *traversal, node_ind_t start,
 
   for (node_ind_t i = 0; i < amount; i++) {
     const node_ind_t node_index = traversal->inds[start + i];
-    const parse_node node = traversal->nodes[node_index];
-    if (node.type.statement == PT_STATEMENT_FUN) {
+    if (PT_NODE_TAG(*traversal, node_index) == PT_ALL_STATEMENT_FUN) {
       tr_maybe_push_environment(traversal, node_index, TR_ACT_PREDECLARE_FN);
     }
   }
@@ -437,7 +455,8 @@ static void tr_handle_initial(pt_traversal *traversal) {
 
 pt_traversal pt_walk(parse_tree tree, traverse_mode mode) {
   pt_traversal res = {
-    .nodes = tree.nodes,
+    .tags = tree.tags,
+    .node_data = tree.node_data,
     .inds = tree.inds,
     .mode = mode,
     .wanted_actions =
@@ -450,14 +469,49 @@ pt_traversal pt_walk(parse_tree tree, traverse_mode mode) {
         .traverse_patterns_in = test_should(traverse_patterns_in, mode),
         .traverse_patterns_out = test_should(traverse_patterns_out, mode),
       },
-    // .path = VEC_NEW,
-    .node_stack = VEC_NEW,
     .environment_amt = builtin_term_amount,
   };
-  // to represent root
-  // VEC_PUSH(&res.path, PT_ALL_LEN);
-  const traverse_action act = TR_END;
-  VEC_PUSH(&res.actions, act);
+
+  // The roots are pushed all at once. In a letrec, FUN statements are pushed
+  // as far as their children, and predeclared.
+  size_t root_actions = 1;
+  size_t root_nodes = 0;
+  for (node_ind_t i = 0; i < tree.root_subs_amt; i++) {
+    const node_ind_t node_index = tree.inds[tree.root_subs_start + i];
+    if (res.wanted_actions.edit_environment &&
+        PT_NODE_TAG(tree, node_index) == PT_ALL_STATEMENT_FUN) {
+      const node_ind_t sub_amt = tree.node_data[node_index].more_subs.amt;
+      root_actions += sub_amt + 5;
+      root_nodes += sub_amt + 3;
+    } else {
+      root_actions++;
+      root_nodes++;
+    }
+  }
+  // Walking under a root leaves at most max_depth nodes' worth of actions
+  // on top of what's left of the roots'. Each of those nodes is either a
+  // later sibling, waiting to be visited, or an ancestor, waiting to be
+  // visited on the way out. Only FN and FUN nodes back up the environment.
+  const size_t depth = tree.max_depth;
+  const size_t actions_cap = root_actions + TR_MAX_ACTIONS_PER_NODE * depth;
+  const size_t nodes_cap = root_nodes + TR_MAX_NODES_PER_NODE * depth;
+  const size_t environment_cap = depth + 1;
+  char *buf = malloc(sizeof(traverse_action_internal) * actions_cap +
+                     sizeof(environment_ind_t) * environment_cap +
+                     sizeof(node_ind_t) * nodes_cap);
+  res.actions = (traverse_action_internal *)buf;
+  res.environment_len_stack =
+    (environment_ind_t *)(buf + sizeof(traverse_action_internal) * actions_cap);
+  res.node_stack =
+    (node_ind_t *)((char *)res.environment_len_stack +
+                   sizeof(environment_ind_t) * environment_cap);
+#ifndef NDEBUG
+  res.actions_cap = actions_cap;
+  res.environment_len_stack_cap = environment_cap;
+  res.node_stack_cap = nodes_cap;
+#endif
+
+  tr_push_raw_action(&res, TR_ACT_END);
   if (res.wanted_actions.edit_environment) {
     pt_traverse_push_letrec(&res, tree.root_subs_start, tree.root_subs_amt);
   } else {
@@ -469,14 +523,17 @@ pt_traversal pt_walk(parse_tree tree, traverse_mode mode) {
 // pre-then-postorder traversal
 pt_traverse_elem pt_walk_next(pt_traversal *traversal) {
   pt_traverse_elem res;
-  while (traversal->actions.len > 0) {
-    traverse_action_internal act;
-    VEC_POP(&traversal->actions, &act);
+  while (traversal->actions_len > 0) {
+    const traverse_action_internal act =
+      traversal->actions[--traversal->actions_len];
     res.action = (traverse_action)act;
 
     switch (act) {
       case TR_ACT_BACKUP_SCOPE:
-        VEC_PUSH(&traversal->environment_len_stack, traversal->environment_amt);
+        debug_assert(traversal->environment_len_stack_len <
+                     traversal->environment_len_stack_cap);
+        traversal->environment_len_stack
+          [traversal->environment_len_stack_len++] = traversal->environment_amt;
         continue;
       case TR_ACT_PREDECLARE_FN:
       case TR_ACT_PUSH_SCOPE_VAR:
@@ -492,22 +549,20 @@ pt_traverse_elem pt_walk_next(pt_traversal *traversal) {
         tr_handle_initial(traversal);
         continue;
       case TR_ACT_POP_TO:
-        VEC_POP(&traversal->environment_len_stack,
-                &res.data.new_environment_amount);
+        res.data.new_environment_amount =
+          traversal->environment_len_stack
+            [--traversal->environment_len_stack_len];
         traversal->environment_amt = res.data.new_environment_amount;
         break;
       case TR_ACT_END:
-        VEC_FREE(&traversal->actions);
-        VEC_FREE(&traversal->environment_len_stack);
-        VEC_FREE(&traversal->node_stack);
+        free(traversal->actions);
+        traversal->actions = NULL;
         break;
       case TR_ACT_NEW_BLOCK:
         break;
       case TR_ACT_ANNOTATE: {
-        node_ind_t node_index;
-        node_ind_t target_ind;
-        VEC_POP(&traversal->node_stack, &node_index);
-        VEC_POP(&traversal->node_stack, &target_ind);
+        const node_ind_t node_index = tr_pop_node_index(traversal);
+        const node_ind_t target_ind = tr_pop_node_index(traversal);
         res.data.annotation_data.annotation_index = node_index;
         res.data.annotation_data.target_index = target_ind;
         break;
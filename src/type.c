@@ -58,10 +58,10 @@ static const tree_node_repr type_repr_arr[] = {
 
   // TODO shouldn't this be exernal
   [TC_CALL] = SUBS_TWO,
-  [TC_TUP] = SUBS_TWO,
 
   [TC_OR] = SUBS_EXTERNAL,
   [TC_FN] = SUBS_EXTERNAL,
+  [TC_TUP] = SUBS_EXTERNAL,
 
 };
 
@@ -99,7 +99,7 @@ static void print_type_head(FILE *f, type_check_tag head) {
 void print_type_head_placeholders(FILE *f, type_check_tag head) {
   switch (head) {
     case TC_TUP:
-      fputs("(a1, a2)", f);
+      fputs("(a1, ..., an)", f);
       break;
     default:
       print_type_head(f, head);
@@ -145,9 +145,11 @@ void print_type(FILE *f, type *types, node_ind_t *inds, node_ind_t root) {
             break;
           case TC_TUP:
             putc('(', f);
-            push_node(&stack, T_TUP_SUB_A(node));
-            push_str(&stack, ", ");
-            push_node(&stack, T_TUP_SUB_B(node));
+            push_node(&stack, T_TUP_SUB_IND(inds, node, 0));
+            for (node_ind_t i = 1; i < T_TUP_SUB_AMT(node); i++) {
+              push_str(&stack, ", ");
+              push_node(&stack, T_TUP_SUB_IND(inds, node, i));
+            }
             push_str(&stack, ")");
             break;
           case TC_LIST:
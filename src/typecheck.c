@@ -233,13 +233,16 @@ static void generate_constraints_visit(tc_constraint_builder *builder,
     case PT_ALL_TY_TUP:
     case PT_ALL_PAT_TUP:
     case PT_ALL_EX_TUP: {
-      const node_ind_t sub_a_ind = PT_TUP_SUB_A(node);
-      const node_ind_t sub_b_ind = PT_TUP_SUB_B(node);
-      const type_ref sub_a_type = generate_node_type(builder, sub_a_ind);
-      const type_ref sub_b_type = generate_node_type(builder, sub_b_ind);
+      const node_ind_t sub_amt = PT_TUP_SUB_AMT(node);
+      type_ref *sub_types = stalloc(sizeof(type_ref) * sub_amt);
+      for (node_ind_t i = 0; i < sub_amt; i++) {
+        const node_ind_t sub_ind = PT_TUP_SUB_IND(builder->tree.inds, node, i);
+        sub_types[i] = generate_node_type(builder, sub_ind);
+      }
       const type_ref tup_type =
-        mk_type_inline(builder->type_builder, TC_TUP, sub_a_type, sub_b_type);
+        mk_type(builder->type_builder, TC_TUP, sub_types, sub_amt);
       add_type_constraint(builder, our_type, tup_type, node_ind);
+      stfree(sub_types, sizeof(type_ref) * sub_amt);
       break;
     }
     case PT_ALL_TY_UNIT:
@@ -415,11 +418,11 @@ static void unify_typevar(unification_state *state, typevar a, type_ref b_ind,
   if (a < state->tree.node_amt) {
     if (b.tag.check == TC_VAR) {
       printf(RED "%s" RESET " := " RED "%s" RESET "\n",
-             parse_node_strings[state->tree.nodes[a].type.all],
-             parse_node_strings[state->tree.nodes[b.data.type_var].type.all]);
+             parse_node_strings[PT_NODE_TAG(state->tree, a)],
+             parse_node_strings[PT_NODE_TAG(state->tree, b.data.type_var)]);
     } else {
       printf(RED "%s" RESET "\n",
-             parse_node_strings[state->tree.nodes[a].type.all]);
+             parse_node_strings[PT_NODE_TAG(state->tree, a)]);
     }
   }
 #endif
@@ -737,7 +740,7 @@ static void print_tyvar_parse_node(parse_tree tree, type *types, type_ref ref) {
     return;
   }
   fputs("Parse node: ", stdout);
-  puts(parse_node_strings[tree.nodes[t.data.type_var].type.all]);
+  puts(parse_node_strings[PT_NODE_TAG(tree, t.data.type_var)]);
   putc('\n', stdout);
 }
 #endif
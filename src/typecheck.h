@@ -5,6 +5,7 @@
 #pragma once
 
 #include "defs.h"
+#include "line_index.h"
 #include "parse_tree.h"
 #include "vec.h"
 #include "types.h"
@@ -69,6 +70,6 @@ typedef struct {
 #endif
 } tc_res;
 
-void print_tc_errors(FILE *, const char *input, parse_tree, tc_res);
+void print_tc_errors(FILE *, const line_index *lines, parse_tree, tc_res);
 tc_res typecheck(parse_tree tree);
 void free_tc_res(tc_res res);
@@ -10,6 +10,19 @@
 #include "hashers.h"
 #include "typedefs.h"
 
+// type_refs are node_ind_ts, so with NARROW_INDICES, a unit whose source
+// fits can still need more types than we can refer to
+static void push_type(type_builder *tb, type t) {
+#ifdef NARROW_INDICES
+  if (HEDLEY_UNLIKELY(tb->types.len >= NODE_IND_MAX ||
+                      tb->inds.len > NODE_IND_MAX)) {
+    give_up("Too many types for 16-bit indices. Try a build without "
+            "NARROW_INDICES.");
+  }
+#endif
+  VEC_PUSH(&tb->types, t);
+}
+
 NON_NULL_PARAMS
 static type_ref find_inline_type(type_builder *tb, type_check_tag tag,
                                  type_ref sub_a, type_ref sub_b) {
@@ -24,7 +37,7 @@ static type_ref find_inline_type(type_builder *tb, type_check_tag tag,
   u32 bucket_ind = ahm_lookup(&tb->type_to_index, &key, tb);
   // TODO remove this branch somehow
   return bs_get(tb->type_to_index.occupied, bucket_ind)
-           ? ((u32 *)tb->type_to_index.keys)[bucket_ind]
+           ? ((type_ref *)tb->type_to_index.keys)[bucket_ind]
            : tb->types.len;
 }
 
@@ -33,7 +46,7 @@ static type_ref find_type(type_builder *tb, const type_key_with_ctx *key) {
   u32 bucket_ind = ahm_lookup(&tb->type_to_index, key, tb);
   // TODO remove this branch somehow
   return bs_get(tb->type_to_index.occupied, bucket_ind)
-           ? ((u32 *)tb->type_to_index.keys)[bucket_ind]
+           ? ((type_ref *)tb->type_to_index.keys)[bucket_ind]
            : tb->types.len;
 }
 
@@ -47,7 +60,7 @@ static type_ref insert_inline_type_to_hm(type_builder *tb, type_check_tag tag,
         .b = sub_b,
       },
   };
-  VEC_PUSH(&tb->types, t);
+  push_type(tb, t);
   type_ref res = tb->types.len - 1;
   ahm_insert_stored(&tb->type_to_index, &res, NULL, tb);
   return tb->types.len - 1;
@@ -98,7 +111,7 @@ type_ref mk_type(type_builder *tb, type_check_tag tag, const type_ref *subs,
         .start = tb->inds.len - sub_amt,
       },
   };
-  VEC_PUSH(&tb->types, t);
+  push_type(tb, t);
   type_ref res = tb->types.len - 1;
   // won't update
   ahm_insert_stored(&tb->type_to_index, &res, &res, tb);
@@ -112,7 +125,7 @@ type_ref mk_type_var(type_builder *tb, typevar value) {
   };
   // Don't check for duplicates, because type variables should be unique
   // and constructed once
-  VEC_PUSH(&tb->types, t);
+  push_type(tb, t);
   return tb->types.len - 1;
 }
 
@@ -140,8 +140,8 @@ typedef struct {
 
 #define T_LIST_SUB_IND(node) node.data.one_sub.ind
 
-#define T_TUP_SUB_A(node) node.data.two_subs.a
-#define T_TUP_SUB_B(node) node.data.two_subs.b
+#define T_TUP_SUB_AMT(node) ((node).data.more_subs.amt)
+#define T_TUP_SUB_IND(inds, node, i) (inds)[(node).data.more_subs.start + i]
 
 void free_type_builder(type_builder tb);
 
@@ -14,6 +14,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#ifndef PREDEF_OS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 #include "attrs.h"
@@ -173,19 +177,38 @@ void ss_finalize(stringstream *ss) {
 }
 
 // You're probably reading from stdin...
-// We won't worry too much about the extra copy
 NON_NULL_PARAMS
 char *read_entire_file_no_seek(FILE *restrict f) {
-  stringstream ss;
-  ss_init_immovable(&ss);
-  char buf[4096];
-  do {
-    size_t amt = fread(buf, 1, 4096, f);
-    fwrite(buf, 1, amt, ss.stream);
-  } while (!feof(f));
-  fputc('\0', ss.stream);
-  ss_finalize(&ss);
-  return ss.string;
+  // Big reads go straight into our buffer, rather than through stdio's
+  size_t cap = 64 * 1024;
+  size_t len = 0;
+  char *buf = malloc_safe(cap);
+  for (;;) {
+    if (cap - len < cap / 4) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      if (buf == NULL) {
+        fputs("Couldn't allocate memory", stderr);
+        exit(1);
+      }
+    }
+    // leave room for the NUL
+    size_t want = cap - len - 1;
+    size_t amt = fread(buf + len, 1, want, f);
+    len += amt;
+    if (amt < want)
+      break;
+  }
+  if (ferror(f)) {
+    perror("Error reading from file");
+    exit(1);
+  }
+  if (len > SOURCE_LEN_MAX) {
+    fprintf(stderr, "File size can't exceed %" PRBI "\n", SOURCE_LEN_MAX);
+    exit(1);
+  }
+  buf[len] = '\0';
+  return buf;
 }
 
 NON_NULL_PARAMS
@@ -207,16 +230,14 @@ char *read_entire_file(const char *restrict file_path) {
     }
   } else {
     long fsize = ftell(f);
-    buf_ind_t max_buf = 0;
-    max_buf -= 1;
     const char *restrict err_reading = "Error reading from file, ";
     if (fsize < 0) {
       fputs(err_reading, stderr);
       perror("negative size returned");
       exit(1);
     }
-    if ((buf_ind_t)fsize > max_buf) {
-      fprintf(stderr, "File size can't exceed %d\n", max_buf);
+    if ((uintmax_t)fsize > SOURCE_LEN_MAX) {
+      fprintf(stderr, "File size can't exceed %" PRBI "\n", SOURCE_LEN_MAX);
       exit(1);
     }
     rewind(f);
@@ -234,6 +255,87 @@ char *read_entire_file(const char *restrict file_path) {
   }
 }
 
+static mapped_file read_entire_file_unmapped(const char *restrict file_path) {
+  mapped_file res = {
+    .data = read_entire_file(file_path),
+    .mapped_bytes = 0,
+  };
+  return res;
+}
+
+#ifdef PREDEF_OS_WINDOWS
+
+mapped_file map_entire_file(const char *restrict file_path) {
+  return read_entire_file_unmapped(file_path);
+}
+
+#else
+
+// We reserve a zeroed, anonymous region one byte bigger than the file, then
+// map the file over the start of it. Whatever follows the file, whether that's
+// the rest of its last page, or the spare page, reads as zero, so we get the
+// scanner's NUL sentinel without copying anything.
+mapped_file map_entire_file(const char *restrict file_path) {
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    // let the usual path report the error
+    return read_entire_file_unmapped(file_path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    // pipes, character devices, etc.
+    close(fd);
+    return read_entire_file_unmapped(file_path);
+  }
+
+  if ((uintmax_t)st.st_size > SOURCE_LEN_MAX) {
+    fprintf(stderr, "File size can't exceed %" PRBI "\n", SOURCE_LEN_MAX);
+    exit(1);
+  }
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t file_bytes = st.st_size;
+  size_t file_pages_bytes = (file_bytes + page - 1) / page * page;
+  size_t mapped_bytes = (file_bytes + 1 + page - 1) / page * page;
+
+  char *data = mmap(
+    NULL, mapped_bytes, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return read_entire_file_unmapped(file_path);
+  }
+  if (file_bytes > 0 &&
+      mmap(data,
+           file_pages_bytes,
+           PROT_READ,
+           MAP_PRIVATE | MAP_FIXED,
+           fd,
+           0) == MAP_FAILED) {
+    munmap(data, mapped_bytes);
+    close(fd);
+    return read_entire_file_unmapped(file_path);
+  }
+  close(fd);
+
+  mapped_file res = {
+    .data = data,
+    .mapped_bytes = mapped_bytes,
+  };
+  return res;
+}
+
+#endif
+
+void unmap_entire_file(mapped_file file) {
+#ifndef PREDEF_OS_WINDOWS
+  if (file.mapped_bytes > 0) {
+    munmap((void *)file.data, file.mapped_bytes);
+    return;
+  }
+#endif
+  free((void *)file.data);
+}
+
 NON_NULL_PARAMS
 int vasprintf(char **buf, const char *restrict fmt, va_list rest) {
   stringstream ss;
@@ -194,6 +194,19 @@ char *read_entire_file(const char *restrict file_path);
 NON_NULL_PARAMS
 char *read_entire_file_no_seek(FILE *restrict f);
 
+typedef struct {
+  const char *data;
+  // zero if `data` was read into a heap buffer, rather than mapped
+  size_t mapped_bytes;
+} mapped_file;
+
+// Like read_entire_file, but regular files are mapped rather than copied.
+// The result is NUL terminated either way.
+NON_NULL_PARAMS
+mapped_file map_entire_file(const char *restrict file_path);
+
+void unmap_entire_file(mapped_file file);
+
 #ifdef PREDEF_OS_WINDOWS
 #include "platform/windows/mkdir.h"
 #endif
@@ -110,6 +110,13 @@ void __vec_push(vec_void *vec, void *el, size_t elemsize);
     __vec_push((vec_void *)vec, (void *)&__el, sizeof(el));                    \
   }
 
+// For stacks whose size is known, and reserved, up front
+#define VEC_PUSH_RESERVED(vec, el)                                             \
+  {                                                                            \
+    debug_assert((vec)->len < (vec)->cap);                                     \
+    VEC_DATA_PTR(vec)[(vec)->len++] = (el);                                    \
+  }
+
 #if INLINE_VEC_BYTES > 0
 vec_void *__vec_pop(vec_void *vec, size_t elemsize);
 #define VEC_POP_(vec)                                                          \